@@ -0,0 +1,633 @@
+#include "assembler.h"
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <unordered_map>
+
+static const OpInfo op_infos[] = {
+    {"li", ALU, false, false, true},
+    {"lui", ALU, false, false, true},
+    {"add", ALU, true, true, true},
+    {"sub", ALU, true, true, true},
+    {"mul", MULTIPLY, true, true, true},
+    {"mulh", MULTIPLY, true, true, true},
+    {"mulhu", MULTIPLY, true, true, true},
+    {"div", DIVIDE, true, true, true},
+    {"divu", DIVIDE, true, true, true},
+    {"rem", DIVIDE, true, true, true},
+    {"remu", DIVIDE, true, true, true},
+    {"slt", ALU, true, true, true},
+    {"sltu", ALU, true, true, true},
+    {"xor", ALU, true, true, true},
+    {"or", ALU, true, true, true},
+    {"and", ALU, true, true, true},
+    {"sll", ALU, true, true, true},
+    {"srl", ALU, true, true, true},
+    {"sra", ALU, true, true, true},
+    {"sh1add", ALU, true, true, true},
+    {"sh2add", ALU, true, true, true},
+    {"sh3add", ALU, true, true, true},
+    {"min", ALU, true, true, true},
+    {"max", ALU, true, true, true},
+    {"minu", ALU, true, true, true},
+    {"maxu", ALU, true, true, true},
+    {"andn", ALU, true, true, true},
+    {"orn", ALU, true, true, true},
+    {"xnor", ALU, true, true, true},
+    {"czero.eqz", ALU, true, true, true},
+    {"czero.nez", ALU, true, true, true},
+    {"addi", ALU, true, false, true},
+    {"slti", ALU, true, false, true},
+    {"sltiu", ALU, true, false, true},
+    {"xori", ALU, true, false, true},
+    {"ori", ALU, true, false, true},
+    {"andi", ALU, true, false, true},
+    {"slli", ALU, true, false, true},
+    {"srli", ALU, true, false, true},
+    {"srai", ALU, true, false, true},
+    {"lw", LOAD, true, false, true},
+    {"lbu", LOAD, true, false, true},
+    {"sw", STORE, true, true, false},
+    {"sb", STORE, true, true, false},
+    {"beq", BRANCH, true, true, false},
+    {"bne", BRANCH, true, true, false},
+    {"blt", BRANCH, true, true, false},
+    {"bge", BRANCH, true, true, false},
+    {"bltu", BRANCH, true, true, false},
+    {"bgeu", BRANCH, true, true, false},
+    {"j", JUMP, false, false, false},
+    {"call", JUMP, false, false, false},
+    {"jr", JUMP, true, false, false},
+    {"ecall", SYSTEM, false, false, false},
+    {"fence", SYSTEM, false, false, false},
+    {"rdcycle", SYSTEM, false, false, true},
+    {"rdinstret", SYSTEM, false, false, true},
+    {"vsetvli", VECTOR, true, false, true},
+    {"vle32.v", VECTOR, true, false, false},
+    {"vse32.v", VECTOR, true, false, false},
+    {"vmv.v.i", VECTOR, false, false, false},
+    {"vmv.v.x", VECTOR, true, false, false},
+    {"vmv.s.x", VECTOR, true, false, false},
+    {"vmv.x.s", VECTOR, false, false, true},
+    {"vredsum.vs", VECTOR, false, false, false},
+    {"vadd.vv", VECTOR, false, false, false},
+    {"vsub.vv", VECTOR, false, false, false},
+    {"vmul.vv", VECTOR, false, false, false},
+    {"vadd.vx", VECTOR, false, true, false},
+    {"vsub.vx", VECTOR, false, true, false},
+    {"vrsub.vx", VECTOR, false, true, false},
+    {"vmul.vx", VECTOR, false, true, false},
+};
+
+static_assert(sizeof(op_infos) / sizeof(op_infos[0]) == (size_t) SOp::COUNT);
+
+const OpInfo & op_info(SOp op) {
+    return op_infos[(int) op];
+}
+
+const char * class_name(OpClass cls) {
+    static const char * names[] = {"alu", "mul", "div", "load", "store", "branch", "jump", "system", "vector"};
+    static_assert(sizeof(names) / sizeof(names[0]) == CLASS_COUNT);
+    return names[cls];
+}
+
+static const char * runtime_names[] = {
+    "getint", "getch", "getarray", "putint", "putch", "putarray", "starttime", "stoptime", "_sysy_starttime", "_sysy_stoptime",
+};
+
+int runtime_count() {
+    return sizeof(runtime_names) / sizeof(runtime_names[0]);
+}
+
+const char * runtime_name(int k) {
+    return runtime_names[k];
+}
+
+// 汇编语句的写法, 决定操作数怎样对应到 SInst 的字段
+enum Format {
+    R,       // rd, rs1, rs2
+    R_SWAP,  // sgt rd, a, b 即 slt rd, b, a
+    I,       // rd, rs1, imm
+    LI,      // rd, imm
+    LA,      // rd, 符号
+    MV,      // rd, rs 即 addi rd, rs, 0
+    NOT,     // xori rd, rs, -1
+    NEG,     // sub rd, zero, rs
+    SEQZ,    // sltiu rd, rs, 1
+    SNEZ,    // sltu rd, zero, rs
+    MEM,     // rd/rs2, imm(rs1)
+    B,       // rs1, rs2, 标号
+    B_SWAP,  // bgt a, b 即 blt b, a
+    BZ,      // beqz rs 即 beq rs, zero
+    BZ_SWAP, // blez rs 即 bge zero, rs
+    JUMP_TO, // j 标号
+    CALL_TO, // call 符号
+    JR_REG,  // jr rs
+    RET,     // jr ra
+    NONE,    // 忽略操作数
+    NOP,     // addi zero, zero, 0
+    RD,      // rdcycle rd
+    VSET,    // vsetvli rd, rs1, e32, mN, ...
+    VMEM,    // vd, (rs1)
+    V3,      // vd, vs2, vs1/rs1
+    VX,      // vmv.v.x vd, rs1
+    VI,      // vmv.v.i vd, imm
+    XV,      // vmv.x.s rd, vs
+};
+
+struct Mnemonic {
+    SOp    op;
+    Format format;
+};
+
+static const std::unordered_map<std::string, Mnemonic> mnemonics = {
+    {"li", {SOp::LI, LI}},
+    {"la", {SOp::LI, LA}},
+    {"lla", {SOp::LI, LA}},
+    {"lui", {SOp::LUI, LI}},
+    {"mv", {SOp::ADDI, MV}},
+    {"not", {SOp::XORI, NOT}},
+    {"neg", {SOp::SUB, NEG}},
+    {"seqz", {SOp::SLTIU, SEQZ}},
+    {"snez", {SOp::SLTU, SNEZ}},
+    {"add", {SOp::ADD, R}},
+    {"sub", {SOp::SUB, R}},
+    {"mul", {SOp::MUL, R}},
+    {"mulh", {SOp::MULH, R}},
+    {"mulhu", {SOp::MULHU, R}},
+    {"div", {SOp::DIV, R}},
+    {"divu", {SOp::DIVU, R}},
+    {"rem", {SOp::REM, R}},
+    {"remu", {SOp::REMU, R}},
+    {"slt", {SOp::SLT, R}},
+    {"sltu", {SOp::SLTU, R}},
+    {"sgt", {SOp::SLT, R_SWAP}},
+    {"sgtu", {SOp::SLTU, R_SWAP}},
+    {"xor", {SOp::XOR, R}},
+    {"or", {SOp::OR, R}},
+    {"and", {SOp::AND, R}},
+    {"sll", {SOp::SLL, R}},
+    {"srl", {SOp::SRL, R}},
+    {"sra", {SOp::SRA, R}},
+    {"sh1add", {SOp::SH1ADD, R}},
+    {"sh2add", {SOp::SH2ADD, R}},
+    {"sh3add", {SOp::SH3ADD, R}},
+    {"min", {SOp::MIN, R}},
+    {"max", {SOp::MAX, R}},
+    {"minu", {SOp::MINU, R}},
+    {"maxu", {SOp::MAXU, R}},
+    {"andn", {SOp::ANDN, R}},
+    {"orn", {SOp::ORN, R}},
+    {"xnor", {SOp::XNOR, R}},
+    {"czero.eqz", {SOp::CZERO_EQZ, R}},
+    {"czero.nez", {SOp::CZERO_NEZ, R}},
+    {"addi", {SOp::ADDI, I}},
+    {"slti", {SOp::SLTI, I}},
+    {"sltiu", {SOp::SLTIU, I}},
+    {"xori", {SOp::XORI, I}},
+    {"ori", {SOp::ORI, I}},
+    {"andi", {SOp::ANDI, I}},
+    {"slli", {SOp::SLLI, I}},
+    {"srli", {SOp::SRLI, I}},
+    {"srai", {SOp::SRAI, I}},
+    {"lw", {SOp::LW, MEM}},
+    {"lbu", {SOp::LBU, MEM}},
+    {"sw", {SOp::SW, MEM}},
+    {"sb", {SOp::SB, MEM}},
+    {"beq", {SOp::BEQ, B}},
+    {"bne", {SOp::BNE, B}},
+    {"blt", {SOp::BLT, B}},
+    {"bge", {SOp::BGE, B}},
+    {"bltu", {SOp::BLTU, B}},
+    {"bgeu", {SOp::BGEU, B}},
+    {"bgt", {SOp::BLT, B_SWAP}},
+    {"ble", {SOp::BGE, B_SWAP}},
+    {"bgtu", {SOp::BLTU, B_SWAP}},
+    {"bleu", {SOp::BGEU, B_SWAP}},
+    {"beqz", {SOp::BEQ, BZ}},
+    {"bnez", {SOp::BNE, BZ}},
+    {"bltz", {SOp::BLT, BZ}},
+    {"bgez", {SOp::BGE, BZ}},
+    {"blez", {SOp::BGE, BZ_SWAP}},
+    {"bgtz", {SOp::BLT, BZ_SWAP}},
+    {"j", {SOp::J, JUMP_TO}},
+    {"call", {SOp::CALL, CALL_TO}},
+    {"jr", {SOp::JR, JR_REG}},
+    {"ret", {SOp::JR, RET}},
+    {"ecall", {SOp::ECALL, NONE}},
+    {"fence", {SOp::FENCE, NONE}},
+    {"nop", {SOp::ADDI, NOP}},
+    {"rdcycle", {SOp::RDCYCLE, RD}},
+    {"rdinstret", {SOp::RDINSTRET, RD}},
+    {"vsetvli", {SOp::VSETVLI, VSET}},
+    {"vle32.v", {SOp::VLE32, VMEM}},
+    {"vse32.v", {SOp::VSE32, VMEM}},
+    {"vmv.v.i", {SOp::VMV_V_I, VI}},
+    {"vmv.v.x", {SOp::VMV_V_X, VX}},
+    {"vmv.s.x", {SOp::VMV_S_X, VX}},
+    {"vmv.x.s", {SOp::VMV_X_S, XV}},
+    {"vredsum.vs", {SOp::VREDSUM, V3}},
+    {"vadd.vv", {SOp::VADD_VV, V3}},
+    {"vsub.vv", {SOp::VSUB_VV, V3}},
+    {"vmul.vv", {SOp::VMUL_VV, V3}},
+    {"vadd.vx", {SOp::VADD_VX, V3}},
+    {"vsub.vx", {SOp::VSUB_VX, V3}},
+    {"vrsub.vx", {SOp::VRSUB_VX, V3}},
+    {"vmul.vx", {SOp::VMUL_VX, V3}},
+};
+
+static const char * reg_names[] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+namespace {
+
+// 第一遍收集的指令: 符号要等所有标号都知道地址后才能解析
+struct Statement {
+    std::string              mnemonic;
+    std::vector<std::string> operands;
+    uint32_t                 line;
+};
+
+struct Assembler {
+    Program &              prog;
+    std::string &          err;
+    uint32_t               line = 0;
+    std::vector<Statement> statements;
+    std::set<std::string>  globals, entries;
+
+    // .word 中引用符号的位置, 第二遍填入
+    std::vector<std::pair<uint32_t, std::string>> word_fixups;
+
+    bool fail(const std::string & msg) {
+        if (err.empty())
+            err = "line " + std::to_string(line) + ": " + msg;
+        return false;
+    }
+
+    bool number(const std::string & s, int64_t & v) {
+        if (s.empty())
+            return false;
+        size_t pos;
+        try {
+            v = std::stoll(s, &pos, 0);
+        } catch (...) {
+            return false;
+        }
+        return pos == s.size();
+    }
+
+    // 数, 符号, 或者 符号+数 / 符号-数
+    bool value(const std::string & s, int64_t & v) {
+        if (number(s, v))
+            return true;
+        size_t  sign   = s.find_first_of("+-", 1);
+        int64_t offset = 0;
+        if (sign != std::string::npos && ! number(s.substr(sign), offset))
+            return fail("bad expression '" + s + "'");
+        auto it = prog.symbols.find(s.substr(0, sign));
+        if (it != prog.symbols.end()) {
+            v = (int64_t) it->second + offset;
+            return true;
+        }
+        for (int k = 0; k < runtime_count(); ++k)
+            if (s.substr(0, sign) == runtime_names[k]) {
+                v = RUNTIME_BASE + 4 * k + offset;
+                return true;
+            }
+        return fail("undefined symbol '" + s + "'");
+    }
+
+    bool reg(const std::string & s, uint8_t & r) {
+        for (int k = 0; k < 32; ++k)
+            if (s == reg_names[k] || s == "x" + std::to_string(k)) {
+                r = k;
+                return true;
+            }
+        if (s == "fp") {
+            r = 8;
+            return true;
+        }
+        return fail("bad register '" + s + "'");
+    }
+
+    bool vreg(const std::string & s, uint8_t & r) {
+        int64_t k;
+        if (s.size() < 2 || s[0] != 'v' || ! number(s.substr(1), k) || k < 0 || k > 31)
+            return fail("bad vector register '" + s + "'");
+        r = k;
+        return true;
+    }
+
+    // 也可以是 %hi(值) / %lo(值): 加上 0x800 后的高 20 位, 以及与之配对的有符号低 12 位
+    bool imm(const std::string & s, int32_t & v) {
+        int64_t x;
+        bool    hi = s.compare(0, 4, "%hi(") == 0, lo = s.compare(0, 4, "%lo(") == 0;
+        if ((hi || lo) && s.back() == ')') {
+            if (! value(s.substr(4, s.size() - 5), x))
+                return false;
+            uint32_t addr = x;
+            v             = hi ? (addr + 0x800) >> 12 : (int32_t) (addr << 20) >> 20;
+            return true;
+        }
+        if (! value(s, x))
+            return false;
+        v = (int32_t) x;
+        return true;
+    }
+
+    // imm(rs1), 偏移可以省略
+    bool mem(const std::string & s, int32_t & offset, uint8_t & base) {
+        size_t open = s.rfind('('), close = s.rfind(')');
+        if (open == std::string::npos || close != s.size() - 1)
+            return fail("bad memory operand '" + s + "'");
+        offset = 0;
+        if (open && ! imm(s.substr(0, open), offset))
+            return false;
+        return reg(s.substr(open + 1, close - open - 1), base);
+    }
+
+    bool target(const std::string & s, int32_t & index) {
+        auto it = prog.symbols.find(s);
+        if (it == prog.symbols.end() || it->second < TEXT_BASE)
+            return fail("bad branch target '" + s + "'");
+        index = (it->second - TEXT_BASE) / 4;
+        return true;
+    }
+
+    bool collect(const std::string & path);
+    bool directive(const std::string & name, const std::string & rest, const std::vector<std::string> & args, bool & in_text);
+    bool decode(const Statement & st, SInst & inst);
+    void find_functions();
+};
+
+}
+
+static std::string trim(const std::string & s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+static std::vector<std::string> split_operands(const std::string & s) {
+    std::vector<std::string> res;
+    size_t                   begin = 0;
+    while (begin <= s.size() && ! s.empty()) {
+        size_t comma = s.find(',', begin);
+        if (comma == std::string::npos)
+            comma = s.size();
+        res.push_back(trim(s.substr(begin, comma - begin)));
+        begin = comma + 1;
+    }
+    return res;
+}
+
+// 去掉不在字符串中的 # 注释
+static std::string strip_comment(const std::string & s) {
+    bool quoted = false;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '"' && (i == 0 || s[i - 1] != '\\'))
+            quoted = ! quoted;
+        else if (s[i] == '#' && ! quoted)
+            return s.substr(0, i);
+    }
+    return s;
+}
+
+bool Assembler::directive(const std::string & name, const std::string & rest, const std::vector<std::string> & args, bool & in_text) {
+    auto & data = prog.data;
+    if (name == ".text")
+        in_text = true;
+    else if (name == ".data" || name == ".bss" || name == ".rodata" || name == ".sdata" || name == ".sbss")
+        in_text = false;
+    else if (name == ".section")
+        in_text = ! args.empty() && args[0].compare(0, 5, ".text") == 0;
+    else if (name == ".globl" || name == ".global")
+        globals.insert(args.begin(), args.end());
+    else if (in_text)
+        return true;
+    else if (name == ".align" || name == ".p2align" || name == ".balign") {
+        int64_t n;
+        if (args.empty() || ! number(args[0], n) || n < 0 || (name != ".balign" && n > 16))
+            return fail("bad alignment");
+        size_t align = name == ".balign" ? n : (size_t) 1 << n;
+        if (align > 1)
+            data.resize((data.size() + align - 1) / align * align);
+    } else if (name == ".zero" || name == ".space") {
+        int64_t n;
+        if (args.empty() || ! number(args[0], n) || n < 0)
+            return fail("bad size");
+        data.resize(data.size() + n);
+    } else if (name == ".word" || name == ".byte") {
+        for (const auto & arg : args) {
+            int64_t v = 0;
+            if (! number(arg, v)) {
+                if (name == ".byte")
+                    return fail("bad byte '" + arg + "'");
+                word_fixups.push_back({data.size(), arg});
+            }
+            for (int k = 0; k < (name == ".word" ? 4 : 1); ++k)
+                data.push_back(v >> 8 * k);
+        }
+    } else if (name == ".asciz" || name == ".string") {
+        size_t open = rest.find('"'), close = rest.rfind('"');
+        if (open == std::string::npos || close == open)
+            return fail("bad string");
+        for (size_t i = open + 1; i < close; ++i) {
+            char c = rest[i];
+            if (c == '\\' && i + 1 < close) {
+                c = rest[++i];
+                c = c == 'n' ? '\n' : c == 't' ? '\t' : c == '0' ? '\0' : c;
+            }
+            data.push_back(c);
+        }
+        data.push_back(0);
+    }
+    return true;
+}
+
+bool Assembler::collect(const std::string & path) {
+    std::ifstream in(path);
+    if (! in)
+        return fail("cannot open " + path);
+
+    bool        in_text = true;
+    std::string text;
+    while (std::getline(in, text)) {
+        ++line;
+        text = trim(strip_comment(text));
+        // 行首的标号, 可能有多个
+        for (size_t colon; (colon = text.find(':')) != std::string::npos && text.find_first_of(" \t\"") > colon;) {
+            std::string label = text.substr(0, colon);
+            if (prog.symbols.count(label))
+                return fail("duplicate label '" + label + "'");
+            prog.symbols[label] = in_text ? TEXT_BASE + 4 * statements.size() : DATA_BASE + prog.data.size();
+            text                = trim(text.substr(colon + 1));
+        }
+        if (text.empty())
+            continue;
+
+        size_t      space = text.find_first_of(" \t");
+        std::string name  = text.substr(0, space);
+        std::string rest  = space == std::string::npos ? "" : trim(text.substr(space));
+        auto        args  = split_operands(rest);
+        if (name[0] == '.') {
+            if (! directive(name, rest, args, in_text))
+                return false;
+        } else if (! in_text)
+            return fail("instruction outside .text");
+        else
+            statements.push_back({name, args, line});
+    }
+    return true;
+}
+
+bool Assembler::decode(const Statement & st, SInst & inst) {
+    line    = st.line;
+    auto it = mnemonics.find(st.mnemonic);
+    if (it == mnemonics.end())
+        return fail("unknown instruction '" + st.mnemonic + "'");
+    inst.op                            = it->second.op;
+    inst.line                          = st.line;
+    const std::vector<std::string> & a = st.operands;
+
+    // 按 Format 的顺序排列, -1 表示不检查
+    static const int operand_count[] = {3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 2, 2, 1, 1, 1, 0, -1, 0, 1, -1, 2, 3, 2, 2, 2};
+    static_assert(sizeof(operand_count) / sizeof(operand_count[0]) == XV + 1);
+    int expected = operand_count[it->second.format];
+    if (expected >= 0 && (int) a.size() != expected)
+        return fail("wrong number of operands for '" + st.mnemonic + "'");
+
+    switch (it->second.format) {
+    case R:
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs1) && reg(a[2], inst.rs2);
+    case R_SWAP:
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs2) && reg(a[2], inst.rs1);
+    case I:
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs1) && imm(a[2], inst.imm);
+    case LI:
+        if (! reg(a[0], inst.rd) || ! imm(a[1], inst.imm))
+            return false;
+        // 与汇编器的展开一致: 超出 12 位且低 12 位不为 0 时是 lui + addi
+        if (inst.op == SOp::LI && (inst.imm < -2048 || inst.imm > 2047) && (inst.imm & 0xfff))
+            inst.size = 2;
+        return true;
+    case LA:
+        inst.size = 2;
+        if (prog.symbols.count(a[1]) && prog.symbols[a[1]] >= TEXT_BASE)
+            entries.insert(a[1]);
+        return reg(a[0], inst.rd) && imm(a[1], inst.imm);
+    case MV:
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs1);
+    case NOT:
+        inst.imm = -1;
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs1);
+    case NEG:
+    case SNEZ:
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs2);
+    case SEQZ:
+        inst.imm = 1;
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs1);
+    case MEM:
+        if (inst.op == SOp::SW || inst.op == SOp::SB)
+            return reg(a[0], inst.rs2) && mem(a[1], inst.imm, inst.rs1);
+        return reg(a[0], inst.rd) && mem(a[1], inst.imm, inst.rs1);
+    case B:
+        return reg(a[0], inst.rs1) && reg(a[1], inst.rs2) && target(a[2], inst.imm);
+    case B_SWAP:
+        return reg(a[0], inst.rs2) && reg(a[1], inst.rs1) && target(a[2], inst.imm);
+    case BZ:
+        return reg(a[0], inst.rs1) && target(a[1], inst.imm);
+    case BZ_SWAP:
+        return reg(a[0], inst.rs2) && target(a[1], inst.imm);
+    case JUMP_TO:
+        return target(a[0], inst.imm);
+    case CALL_TO:
+        if (prog.symbols.count(a[0]))
+            entries.insert(a[0]);
+        return imm(a[0], inst.imm);
+    case JR_REG:
+        return reg(a[0], inst.rs1);
+    case RET:
+        inst.rs1 = 1;
+        return true;
+    case NONE:
+    case NOP:
+        return true;
+    case RD:
+        return reg(a[0], inst.rd);
+    case VSET: {
+        // 只支持 e32, LMUL 为 1/2/4/8
+        int64_t lmul;
+        if (a.size() < 4 || a[2] != "e32" || a[3].size() != 2 || a[3][0] != 'm' || ! number(a[3].substr(1), lmul) || (lmul & (lmul - 1)) || lmul > 8)
+            return fail("unsupported vtype in vsetvli");
+        inst.imm = lmul;
+        return reg(a[0], inst.rd) && reg(a[1], inst.rs1);
+    }
+    case VMEM:
+        return vreg(a[0], inst.rd) && mem(a[1], inst.imm, inst.rs1);
+    case V3:
+        if (! vreg(a[0], inst.rd) || ! vreg(a[1], inst.rs1))
+            return false;
+        return op_info(inst.op).reads_rs2 ? reg(a[2], inst.rs2) : vreg(a[2], inst.rs2);
+    case VX:
+        return vreg(a[0], inst.rd) && reg(a[1], inst.rs1);
+    case VI:
+        return vreg(a[0], inst.rd) && imm(a[1], inst.imm);
+    case XV:
+        return reg(a[0], inst.rd) && vreg(a[1], inst.rs1);
+    }
+    return false;
+}
+
+void Assembler::find_functions() {
+    std::map<uint32_t, std::string> starts;
+    for (const auto & [name, addr] : prog.symbols)
+        if (addr >= TEXT_BASE && (globals.count(name) || entries.count(name)) && ! starts.count((addr - TEXT_BASE) / 4))
+            starts[(addr - TEXT_BASE) / 4] = name;
+    if (! prog.text.empty() && ! starts.count(0))
+        starts[0] = "(text)";
+
+    for (const auto & [entry, name] : starts) {
+        prog.func_entry.push_back(entry);
+        prog.func_names.push_back(name);
+    }
+    prog.func_of.resize(prog.text.size());
+    for (size_t i = 0, f = 0; i < prog.text.size(); ++i) {
+        while (f + 1 < prog.func_entry.size() && prog.func_entry[f + 1] <= i)
+            ++f;
+        prog.func_of[i] = f;
+    }
+}
+
+bool assemble(const std::string & path, Program & prog, std::string & err) {
+    Assembler as{prog, err};
+    if (! as.collect(path))
+        return false;
+    if (! prog.symbols.count("__global_pointer$"))
+        prog.symbols["__global_pointer$"] = DATA_BASE + 0x800;
+
+    prog.text.resize(as.statements.size());
+    for (size_t i = 0; i < as.statements.size(); ++i)
+        if (! as.decode(as.statements[i], prog.text[i]))
+            return false;
+    for (const auto & [offset, expr] : as.word_fixups) {
+        int64_t v;
+        if (! as.value(expr, v))
+            return false;
+        for (int k = 0; k < 4; ++k)
+            prog.data[offset + k] = v >> 8 * k;
+    }
+
+    as.find_functions();
+    if (! prog.symbols.count("main") || prog.symbols["main"] < TEXT_BASE) {
+        err = "no main function";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// 模拟器执行的指令: 编译器输出的 RV32IM 子集, 以及 Zba/Zbb/Zicond/V 扩展中用到的指令.
+// 伪指令在汇编时换成等价的形式, 如 beqz rs, l 即 beq rs, zero, l; mv rd, rs 即 addi rd, rs, 0
+enum class SOp : uint8_t {
+    LI, LUI,
+    ADD, SUB, MUL, MULH, MULHU, DIV, DIVU, REM, REMU,
+    SLT, SLTU, XOR, OR, AND, SLL, SRL, SRA,
+    SH1ADD, SH2ADD, SH3ADD, MIN, MAX, MINU, MAXU, ANDN, ORN, XNOR, CZERO_EQZ, CZERO_NEZ,
+    ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI,
+    LW, LBU, SW, SB,
+    BEQ, BNE, BLT, BGE, BLTU, BGEU, J, CALL, JR,
+    ECALL, FENCE, RDCYCLE, RDINSTRET,
+    VSETVLI, VLE32, VSE32, VMV_V_I, VMV_V_X, VMV_S_X, VMV_X_S, VREDSUM,
+    VADD_VV, VSUB_VV, VMUL_VV, VADD_VX, VSUB_VX, VRSUB_VX, VMUL_VX,
+    COUNT
+};
+
+// 统计和代价模型按指令类别区分
+enum OpClass : uint8_t { ALU, MULTIPLY, DIVIDE, LOAD, STORE, BRANCH, JUMP, SYSTEM, VECTOR, CLASS_COUNT };
+
+struct OpInfo {
+    const char * name;
+    OpClass      cls;
+    bool         reads_rs1, reads_rs2, writes_rd; // 只计通用寄存器
+};
+
+const OpInfo & op_info(SOp op);
+const char *   class_name(OpClass cls);
+
+// 操作数的排列:
+//   R 型 rd, rs1, rs2    I 型 rd, rs1, imm    li rd, imm (la 也汇编成 li)    lui rd, imm
+//   lw/lbu rd, imm(rs1)  sw/sb rs2, imm(rs1)  b* rs1, rs2, 目标    j 目标    call 地址    jr rs1
+//   rdcycle/rdinstret rd
+//   向量指令的 rd/rs1/rs2 按汇编中的顺序存放 v 或 x 寄存器的编号, vsetvli 的 imm 是 LMUL
+// 分支和 j 的目标是指令下标, call 的目标是地址
+struct SInst {
+    SOp      op;
+    uint8_t  rd = 0, rs1 = 0, rs2 = 0;
+    uint8_t  size = 1; // 展开成的机器指令条数: 需要 lui + addi 的 li 和 auipc + addi 的 la 为 2
+    int32_t  imm  = 0;
+    uint32_t line = 0;
+};
+
+// 地址空间: 数据从 DATA_BASE 开始连续存放, 栈在内存顶端向下生长.
+// 代码不在内存中, 第 i 条指令的地址是 TEXT_BASE + 4i; 运行时库函数 k 的地址是 RUNTIME_BASE + 4k
+const uint32_t RUNTIME_BASE = 0x100;
+const uint32_t DATA_BASE    = 0x10000;
+const uint32_t TEXT_BASE    = 0x80000000;
+
+// getint, getch, getarray, putint, putch, putarray, starttime, stoptime 及其 _sysy_ 前缀的别名
+int          runtime_count();
+const char * runtime_name(int k);
+
+struct Program {
+    std::vector<SInst>              text;
+    std::vector<uint8_t>            data;    // 从 DATA_BASE 开始的初始内容
+    std::map<std::string, uint32_t> symbols; // 标号的地址
+
+    // 函数按入口排列; 入口是 .globl 的代码标号和 call/la 的代码目标. func_of[i] 是第 i 条指令所在的函数
+    std::vector<std::string> func_names;
+    std::vector<uint32_t>    func_entry;
+    std::vector<int>         func_of;
+};
+
+// 读入并汇编 path 中的程序. 出错时在 err 中给出行号和原因, 返回 false
+bool assemble(const std::string & path, Program & prog, std::string & err);
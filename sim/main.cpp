@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "assembler.h"
+#include "simulator.h"
+
+// 模拟执行编译器生成的汇编, 统计动态指令数并按代价模型估计周期数:
+// sim [选项] 程序.s
+// 程序的输入输出使用 stdin/stdout, 退出码是 main 的返回值; 统计报告写到 stderr 或 -report= 指定的文件.
+// 选项:
+//   -tune=generic|rocket|sifive-7-series   代价模型的预置, 与编译器的 -mtune 对应
+//   -latency=load=2,div=10,...             修改模型中的项: alu, load, mul, div, mul_interval, div_interval, taken_branch
+//   -vlen=N                                V 扩展的 VLEN, 默认 128
+//   -memory=N                              内存大小 (MiB), 默认 256
+//   -report=文件 / -no-report
+static void usage() {
+    std::cerr << "usage: sim [-tune=name] [-latency=key=value,...] [-vlen=N] [-memory=MiB] [-report=file | -no-report] program.s" << std::endl;
+}
+
+static bool has_prefix(const std::string & s, const std::string & prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+static bool parse_positive(const std::string & s, int & v) {
+    try {
+        size_t pos;
+        v = std::stoi(s, &pos);
+        return pos == s.size() && v > 0;
+    } catch (...) {
+        return false;
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    SimOptions  options;
+    std::string input, report;
+    bool        quiet = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        int         n;
+        if (has_prefix(arg, "-tune=")) {
+            if (! preset_model(arg.substr(6), options.model)) {
+                std::cerr << "sim: unknown model: " << arg.substr(6) << std::endl;
+                return 255;
+            }
+        } else if (has_prefix(arg, "-latency=")) {
+            if (! parse_latency(arg.substr(9), options.model)) {
+                std::cerr << "sim: bad latency specification: " << arg.substr(9) << std::endl;
+                return 255;
+            }
+        } else if (has_prefix(arg, "-vlen=") && parse_positive(arg.substr(6), n) && n % 32 == 0)
+            options.vlen = n;
+        else if (has_prefix(arg, "-memory=") && parse_positive(arg.substr(8), n) && n < 4096)
+            options.memory = (uint32_t) n << 20;
+        else if (has_prefix(arg, "-report="))
+            report = arg.substr(8);
+        else if (arg == "-no-report")
+            quiet = true;
+        else if (arg[0] != '-' && input.empty())
+            input = arg;
+        else {
+            usage();
+            return 255;
+        }
+    }
+    if (input.empty()) {
+        usage();
+        return 255;
+    }
+
+    Program     prog;
+    std::string err;
+    if (! assemble(input, prog, err)) {
+        std::cerr << "sim: " << input << ": " << err << std::endl;
+        return 255;
+    }
+
+    SimStats stats;
+    bool     ok = simulate(prog, options, stats);
+    std::fflush(stdout);
+    if (! quiet) {
+        if (report.empty())
+            print_report(prog, stats, std::cerr);
+        else {
+            std::ofstream out(report);
+            print_report(prog, stats, out);
+        }
+    }
+    return ok ? stats.exit_code : 255;
+}
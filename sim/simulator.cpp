@@ -0,0 +1,685 @@
+#include "simulator.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+
+bool preset_model(const std::string & name, LatencyModel & model) {
+    static const std::map<std::string, LatencyModel> presets = {
+        {"generic", {1, 3, 3, 20, 1, 20, 2}},
+        {"rocket", {1, 3, 4, 33, 4, 33, 2}},
+        {"sifive-7-series", {1, 3, 3, 34, 1, 34, 2}},
+    };
+    auto it = presets.find(name);
+    if (it == presets.end())
+        return false;
+    model = it->second;
+    return true;
+}
+
+bool parse_latency(const std::string & spec, LatencyModel & model) {
+    static const std::map<std::string, int LatencyModel::*> fields = {
+        {"alu", &LatencyModel::alu},
+        {"load", &LatencyModel::load},
+        {"mul", &LatencyModel::mul},
+        {"div", &LatencyModel::div},
+        {"mul_interval", &LatencyModel::mul_interval},
+        {"div_interval", &LatencyModel::div_interval},
+        {"taken_branch", &LatencyModel::taken_branch},
+    };
+    for (size_t begin = 0; begin < spec.size();) {
+        size_t comma = spec.find(',', begin);
+        if (comma == std::string::npos)
+            comma = spec.size();
+        std::string item = spec.substr(begin, comma - begin);
+        size_t      eq   = item.find('=');
+        if (eq == std::string::npos || ! fields.count(item.substr(0, eq)))
+            return false;
+        char * end;
+        long   v = std::strtol(item.c_str() + eq + 1, &end, 10);
+        if (*end || end == item.c_str() + eq + 1 || v < 0)
+            return false;
+        model.*fields.at(item.substr(0, eq)) = v;
+        begin                                = comma + 1;
+    }
+    return true;
+}
+
+namespace {
+
+enum { ZERO = 0, RA = 1, SP = 2, GP = 3, A0 = 10, A1 = 11, A2 = 12, A4 = 14, A7 = 17 };
+
+// 与 runtime_name 的编号一致
+enum { GETINT, GETCH, GETARRAY, PUTINT, PUTCH, PUTARRAY, STARTTIME, STOPTIME, SYSY_STARTTIME, SYSY_STOPTIME };
+
+// main 的返回地址, 返回到这里即程序结束
+const uint32_t EXIT_ADDR = 0xfffffff0;
+
+const uint32_t clone_child_cleartid = 0x200000; // CLONE_CHILD_CLEARTID
+
+// clone 出的线程立即执行到退出, 期间父线程挂起
+struct Suspended {
+    uint32_t x[32];
+    uint32_t pc;
+    uint32_t clear_tid; // 子线程退出时清零并唤醒的地址, 没有时为 0
+};
+
+struct Simulator {
+    const Program &      prog;
+    const SimOptions &   options;
+    const LatencyModel & model;
+    SimStats &           stats;
+
+    uint8_t * mem;
+    uint32_t  x[32] = {};
+    uint32_t  pc    = 0; // 当前指令的下标
+
+    int                   lanes;
+    std::vector<uint32_t> v;
+    uint32_t              vl = 0;
+
+    // 各寄存器的结果在哪个周期可用, 以及乘/除法部件下一次能发射的周期
+    uint64_t ready[32] = {};
+    uint64_t mul_free = 0, div_free = 0;
+
+    std::vector<Suspended>    parents;
+    std::map<int, FILE *>     files;
+    int                       next_fd = 3, next_tid = 2;
+    bool                      finished = false;
+    uint64_t                  timer_insts = 0, timer_cycles = 0;
+    bool                      timing = false;
+
+    Simulator(const Program & prog, const SimOptions & options, SimStats & stats)
+        : prog(prog), options(options), model(options.model), stats(stats), lanes(options.vlen / 32), v(32 * lanes) {
+        // calloc 得到的页在第一次访问时才真正分配
+        mem = (uint8_t *) std::calloc(options.memory, 1);
+    }
+    ~Simulator() {
+        std::free(mem);
+        for (auto [fd, f] : files)
+            std::fclose(f);
+    }
+
+    bool fault(const std::string & msg) {
+        std::fprintf(stderr, "sim: %s (line %u)\n", msg.c_str(), pc < prog.text.size() ? prog.text[pc].line : 0);
+        return false;
+    }
+
+    bool valid(uint32_t addr, uint32_t n) const {
+        return addr >= DATA_BASE && addr <= options.memory - n;
+    }
+
+    bool load(uint32_t addr, uint32_t & value) {
+        if (! valid(addr, 4))
+            return fault("invalid load from " + hex(addr));
+        value = mem[addr] | mem[addr + 1] << 8 | mem[addr + 2] << 16 | (uint32_t) mem[addr + 3] << 24;
+        return true;
+    }
+
+    bool store(uint32_t addr, uint32_t value) {
+        if (! valid(addr, 4))
+            return fault("invalid store to " + hex(addr));
+        for (int k = 0; k < 4; ++k)
+            mem[addr + k] = value >> 8 * k;
+        return true;
+    }
+
+    static std::string hex(uint32_t v) {
+        char buf[16];
+        std::snprintf(buf, sizeof(buf), "0x%x", v);
+        return buf;
+    }
+
+    void write(int rd, uint32_t value) {
+        if (rd)
+            x[rd] = value;
+    }
+
+    bool is_entry(uint32_t index) const {
+        return prog.func_entry[prog.func_of[index]] == index;
+    }
+
+    bool run();
+    bool step();
+    bool transfer(uint32_t addr, uint32_t & next);
+    bool call_runtime(int k);
+    bool syscall(uint32_t & next);
+    bool vector_op(const SInst & in);
+};
+
+}
+
+bool Simulator::run() {
+    stats.func_calls.assign(prog.func_names.size(), 0);
+    stats.func_insts.assign(prog.func_names.size(), 0);
+    stats.func_cycles.assign(prog.func_names.size(), 0);
+    stats.runtime_calls.assign(runtime_count(), 0);
+    if (! mem) {
+        std::fprintf(stderr, "sim: cannot allocate %u bytes of memory\n", options.memory);
+        return false;
+    }
+    std::copy(prog.data.begin(), prog.data.end(), mem + DATA_BASE);
+
+    x[RA] = EXIT_ADDR;
+    x[SP] = (options.memory - 16) & ~15u;
+    x[GP] = prog.symbols.at("__global_pointer$");
+    pc    = (prog.symbols.at("main") - TEXT_BASE) / 4;
+    ++stats.func_calls[prog.func_of[pc]];
+    while (! finished)
+        if (! step())
+            return false;
+    std::fflush(stdout);
+    return true;
+}
+
+// 转移到地址 addr: 运行时库函数就地执行后返回到 ra, 返回到 EXIT_ADDR 时程序结束
+bool Simulator::transfer(uint32_t addr, uint32_t & next) {
+    if (addr == EXIT_ADDR) {
+        stats.exit_code = x[A0] & 0xff;
+        finished        = true;
+        return true;
+    }
+    if (addr >= RUNTIME_BASE && addr < RUNTIME_BASE + 4 * runtime_count() && addr % 4 == 0) {
+        if (! call_runtime((addr - RUNTIME_BASE) / 4))
+            return false;
+        return transfer(x[RA], next);
+    }
+    if (addr < TEXT_BASE || addr % 4 || (addr - TEXT_BASE) / 4 >= prog.text.size())
+        return fault("jump to invalid address " + hex(addr));
+    next = (addr - TEXT_BASE) / 4;
+    return true;
+}
+
+bool Simulator::call_runtime(int k) {
+    ++stats.runtime_calls[k];
+    switch (k) {
+    case GETINT: {
+        int value = 0;
+        if (std::scanf("%d", &value) != 1)
+            value = 0;
+        x[A0] = value;
+        break;
+    }
+    case GETCH:
+        x[A0] = std::getchar();
+        break;
+    case GETARRAY: {
+        int n = 0;
+        if (std::scanf("%d", &n) != 1)
+            n = 0;
+        for (int i = 0; i < n; ++i) {
+            int value = 0;
+            if (std::scanf("%d", &value) != 1)
+                value = 0;
+            if (! store(x[A0] + 4 * i, value))
+                return false;
+        }
+        x[A0] = n;
+        break;
+    }
+    case PUTINT:
+        std::printf("%d", (int) x[A0]);
+        break;
+    case PUTCH:
+        std::putchar(x[A0]);
+        break;
+    case PUTARRAY: {
+        std::printf("%d:", (int) x[A0]);
+        for (int i = 0; i < (int) x[A0]; ++i) {
+            uint32_t value;
+            if (! load(x[A1] + 4 * i, value))
+                return false;
+            std::printf(" %d", (int) value);
+        }
+        std::printf("\n");
+        break;
+    }
+    case STARTTIME:
+    case SYSY_STARTTIME:
+        timer_insts  = stats.insts;
+        timer_cycles = stats.cycles;
+        timing       = true;
+        break;
+    case STOPTIME:
+    case SYSY_STOPTIME:
+        if (timing) {
+            stats.timed_insts += stats.insts - timer_insts;
+            stats.timed_cycles += stats.cycles - timer_cycles;
+            ++stats.timers;
+            timing = false;
+        }
+        break;
+    }
+    return true;
+}
+
+// 支持运行时例程用到的 Linux 系统调用. clone 出的线程立即执行到退出再回到父线程, 因此 futex 等待总是不必阻塞
+bool Simulator::syscall(uint32_t & next) {
+    switch (x[A7]) {
+    case 93: // exit
+    case 94: // exit_group
+        if (x[A7] == 93 && ! parents.empty()) {
+            Suspended parent = parents.back();
+            parents.pop_back();
+            if (parent.clear_tid && ! store(parent.clear_tid, 0))
+                return false;
+            std::copy(parent.x, parent.x + 32, x);
+            next = parent.pc;
+            return true;
+        }
+        stats.exit_code = x[A0] & 0xff;
+        finished        = true;
+        return true;
+    case 56: { // openat
+        std::string path;
+        for (uint32_t addr = x[A1];; ++addr) {
+            if (! valid(addr, 1))
+                return fault("invalid path for openat");
+            if (! mem[addr])
+                break;
+            path += mem[addr];
+        }
+        FILE * f = std::fopen(path.c_str(), (x[A2] & 3) == 0 ? "r" : x[A2] & 0x400 ? "a" : "w");
+        if (! f)
+            x[A0] = -2;
+        else {
+            files[next_fd] = f;
+            x[A0]          = next_fd++;
+        }
+        return true;
+    }
+    case 57: // close
+        if (files.count(x[A0])) {
+            std::fclose(files[x[A0]]);
+            files.erase(x[A0]);
+        }
+        x[A0] = 0;
+        return true;
+    case 64: { // write
+        FILE * f = x[A0] == 1 ? stdout : x[A0] == 2 ? stderr : files.count(x[A0]) ? files[x[A0]] : nullptr;
+        if (! f) {
+            x[A0] = -9;
+            return true;
+        }
+        if (x[A2] && ! valid(x[A1], x[A2]))
+            return fault("invalid buffer for write");
+        std::fwrite(mem + x[A1], 1, x[A2], f);
+        return true;
+    }
+    case 220: { // clone
+        Suspended parent;
+        std::copy(x, x + 32, parent.x);
+        parent.x[A0]     = next_tid++;
+        parent.pc        = pc + 1;
+        parent.clear_tid = x[A0] & clone_child_cleartid ? x[A4] : 0;
+        parents.push_back(parent);
+        if (x[A1])
+            x[SP] = x[A1];
+        x[A0] = 0;
+        return true;
+    }
+    case 98:
+    case 422: { // futex
+        uint32_t value;
+        if ((x[A1] & 127) != 0)
+            x[A0] = 0;
+        else if (! load(x[A0], value))
+            return false;
+        else if (value == x[A2])
+            return fault("futex wait would block forever");
+        else
+            x[A0] = -11;
+        return true;
+    }
+    default:
+        return fault("unsupported system call " + std::to_string(x[A7]));
+    }
+}
+
+bool Simulator::vector_op(const SInst & in) {
+    // 向量指令中 reads_rs1/reads_rs2 的操作数是通用寄存器, 其余的是 v 寄存器组
+    const OpInfo & info  = op_info(in.op);
+    auto           group = [&](int reg) { return (size_t) reg * lanes + vl <= v.size(); };
+    auto           elem  = [&](int reg, uint32_t i) -> uint32_t & { return v[reg * lanes + i]; };
+    bool           vd    = in.op != SOp::VSETVLI && in.op != SOp::VMV_X_S;
+    if (vd && ! (group(in.rd) && (info.reads_rs1 || group(in.rs1)) && (info.reads_rs2 || group(in.rs2))))
+        return fault("vector register group out of range");
+
+    switch (in.op) {
+    case SOp::VSETVLI: {
+        uint32_t vlmax = lanes * in.imm;
+        uint32_t avl   = in.rs1 ? x[in.rs1] : in.rd ? vlmax : vl;
+        vl             = std::min(avl, vlmax);
+        write(in.rd, vl);
+        break;
+    }
+    case SOp::VLE32:
+    case SOp::VSE32:
+        for (uint32_t i = 0; i < vl; ++i)
+            if (! (in.op == SOp::VLE32 ? load(x[in.rs1] + 4 * i, elem(in.rd, i)) : store(x[in.rs1] + 4 * i, elem(in.rd, i))))
+                return false;
+        break;
+    case SOp::VMV_V_I:
+    case SOp::VMV_V_X:
+        for (uint32_t i = 0; i < vl; ++i)
+            elem(in.rd, i) = in.op == SOp::VMV_V_I ? in.imm : x[in.rs1];
+        break;
+    case SOp::VMV_S_X:
+        if (vl)
+            elem(in.rd, 0) = x[in.rs1];
+        break;
+    case SOp::VMV_X_S:
+        write(in.rd, v[in.rs1 * lanes]);
+        break;
+    case SOp::VREDSUM: {
+        uint32_t sum = elem(in.rs2, 0);
+        for (uint32_t i = 0; i < vl; ++i)
+            sum += elem(in.rs1, i);
+        if (vl)
+            elem(in.rd, 0) = sum;
+        break;
+    }
+    default:
+        for (uint32_t i = 0; i < vl; ++i) {
+            uint32_t a = elem(in.rs1, i);
+            uint32_t b = info.reads_rs2 ? x[in.rs2] : elem(in.rs2, i);
+            uint32_t r;
+            switch (in.op) {
+            case SOp::VADD_VV:
+            case SOp::VADD_VX:
+                r = a + b;
+                break;
+            case SOp::VSUB_VV:
+            case SOp::VSUB_VX:
+                r = a - b;
+                break;
+            case SOp::VRSUB_VX:
+                r = b - a;
+                break;
+            default:
+                r = a * b;
+            }
+            elem(in.rd, i) = r;
+        }
+    }
+    return true;
+}
+
+bool Simulator::step() {
+    if (pc >= prog.text.size())
+        return fault("execution ran off the end of .text");
+    const SInst &  in   = prog.text[pc];
+    const OpInfo & info = op_info(in.op);
+
+    // 顺序发射: 等源操作数就绪, 乘除法还要等部件空闲
+    uint64_t issue = stats.cycles + 1;
+    if (info.reads_rs1)
+        issue = std::max(issue, ready[in.rs1]);
+    if (info.reads_rs2)
+        issue = std::max(issue, ready[in.rs2]);
+    int latency = model.alu;
+    if (info.cls == MULTIPLY) {
+        issue    = std::max(issue, mul_free);
+        mul_free = issue + model.mul_interval;
+        latency  = model.mul;
+    } else if (info.cls == DIVIDE) {
+        issue    = std::max(issue, div_free);
+        div_free = issue + model.div_interval;
+        latency  = model.div;
+    } else if (info.cls == LOAD)
+        latency = model.load;
+    uint64_t done = issue + in.size - 1;
+    if (info.cls == VECTOR && vl > (uint32_t) lanes)
+        done += (vl - 1) / lanes;
+
+    uint32_t a = x[in.rs1], b = x[in.rs2], value;
+    uint32_t next  = pc + 1;
+    bool     taken = false;
+    switch (in.op) {
+    case SOp::LI:
+        write(in.rd, in.imm);
+        break;
+    case SOp::LUI:
+        write(in.rd, (uint32_t) in.imm << 12);
+        break;
+    case SOp::ADD:
+        write(in.rd, a + b);
+        break;
+    case SOp::SUB:
+        write(in.rd, a - b);
+        break;
+    case SOp::MUL:
+        write(in.rd, a * b);
+        break;
+    case SOp::MULH:
+        write(in.rd, (int64_t) (int32_t) a * (int32_t) b >> 32);
+        break;
+    case SOp::MULHU:
+        write(in.rd, (uint64_t) a * b >> 32);
+        break;
+    case SOp::DIV:
+        write(in.rd, b == 0 ? -1 : (int32_t) a == INT32_MIN && (int32_t) b == -1 ? a : (int32_t) a / (int32_t) b);
+        break;
+    case SOp::DIVU:
+        write(in.rd, b == 0 ? -1 : a / b);
+        break;
+    case SOp::REM:
+        write(in.rd, b == 0 ? a : (int32_t) a == INT32_MIN && (int32_t) b == -1 ? 0 : (int32_t) a % (int32_t) b);
+        break;
+    case SOp::REMU:
+        write(in.rd, b == 0 ? a : a % b);
+        break;
+    case SOp::SLT:
+        write(in.rd, (int32_t) a < (int32_t) b);
+        break;
+    case SOp::SLTU:
+        write(in.rd, a < b);
+        break;
+    case SOp::XOR:
+        write(in.rd, a ^ b);
+        break;
+    case SOp::OR:
+        write(in.rd, a | b);
+        break;
+    case SOp::AND:
+        write(in.rd, a & b);
+        break;
+    case SOp::SLL:
+        write(in.rd, a << (b & 31));
+        break;
+    case SOp::SRL:
+        write(in.rd, a >> (b & 31));
+        break;
+    case SOp::SRA:
+        write(in.rd, (int32_t) a >> (b & 31));
+        break;
+    case SOp::SH1ADD:
+        write(in.rd, (a << 1) + b);
+        break;
+    case SOp::SH2ADD:
+        write(in.rd, (a << 2) + b);
+        break;
+    case SOp::SH3ADD:
+        write(in.rd, (a << 3) + b);
+        break;
+    case SOp::MIN:
+        write(in.rd, (int32_t) a < (int32_t) b ? a : b);
+        break;
+    case SOp::MAX:
+        write(in.rd, (int32_t) a > (int32_t) b ? a : b);
+        break;
+    case SOp::MINU:
+        write(in.rd, std::min(a, b));
+        break;
+    case SOp::MAXU:
+        write(in.rd, std::max(a, b));
+        break;
+    case SOp::ANDN:
+        write(in.rd, a & ~b);
+        break;
+    case SOp::ORN:
+        write(in.rd, a | ~b);
+        break;
+    case SOp::XNOR:
+        write(in.rd, ~(a ^ b));
+        break;
+    case SOp::CZERO_EQZ:
+        write(in.rd, b ? a : 0);
+        break;
+    case SOp::CZERO_NEZ:
+        write(in.rd, b ? 0 : a);
+        break;
+    case SOp::ADDI:
+        write(in.rd, a + in.imm);
+        break;
+    case SOp::SLTI:
+        write(in.rd, (int32_t) a < in.imm);
+        break;
+    case SOp::SLTIU:
+        write(in.rd, a < (uint32_t) in.imm);
+        break;
+    case SOp::XORI:
+        write(in.rd, a ^ in.imm);
+        break;
+    case SOp::ORI:
+        write(in.rd, a | in.imm);
+        break;
+    case SOp::ANDI:
+        write(in.rd, a & in.imm);
+        break;
+    case SOp::SLLI:
+        write(in.rd, a << (in.imm & 31));
+        break;
+    case SOp::SRLI:
+        write(in.rd, a >> (in.imm & 31));
+        break;
+    case SOp::SRAI:
+        write(in.rd, (int32_t) a >> (in.imm & 31));
+        break;
+    case SOp::LW:
+        if (! load(a + in.imm, value))
+            return false;
+        write(in.rd, value);
+        break;
+    case SOp::LBU:
+        if (! valid(a + in.imm, 1))
+            return fault("invalid load from " + hex(a + in.imm));
+        write(in.rd, mem[a + in.imm]);
+        break;
+    case SOp::SW:
+        if (! store(a + in.imm, b))
+            return false;
+        break;
+    case SOp::SB:
+        if (! valid(a + in.imm, 1))
+            return fault("invalid store to " + hex(a + in.imm));
+        mem[a + in.imm] = b;
+        break;
+    case SOp::BEQ:
+        taken = a == b;
+        break;
+    case SOp::BNE:
+        taken = a != b;
+        break;
+    case SOp::BLT:
+        taken = (int32_t) a < (int32_t) b;
+        break;
+    case SOp::BGE:
+        taken = (int32_t) a >= (int32_t) b;
+        break;
+    case SOp::BLTU:
+        taken = a < b;
+        break;
+    case SOp::BGEU:
+        taken = a >= b;
+        break;
+    case SOp::J:
+        taken = true;
+        break;
+    case SOp::CALL:
+    case SOp::JR: {
+        uint32_t target = in.op == SOp::CALL ? in.imm : a;
+        taken           = true;
+        if (in.op == SOp::CALL)
+            x[RA] = TEXT_BASE + 4 * (pc + 1);
+        if (! transfer(target, next))
+            return false;
+        if (target >= TEXT_BASE && ! finished && is_entry(next))
+            ++stats.func_calls[prog.func_of[next]];
+        break;
+    }
+    case SOp::ECALL:
+        if (! syscall(next))
+            return false;
+        break;
+    case SOp::FENCE:
+        break;
+    case SOp::RDCYCLE:
+        write(in.rd, issue);
+        break;
+    case SOp::RDINSTRET:
+        write(in.rd, stats.insts);
+        break;
+    default:
+        if (! vector_op(in))
+            return false;
+    }
+    if (taken && (in.op == SOp::J || (in.op >= SOp::BEQ && in.op <= SOp::BGEU)))
+        next = in.imm;
+    if (taken)
+        done += model.taken_branch;
+    if (info.writes_rd && in.rd)
+        ready[in.rd] = done + latency;
+
+    uint64_t spent = done - stats.cycles;
+    int      func  = prog.func_of[pc];
+    stats.cycles   = done;
+    stats.insts += in.size;
+    stats.class_insts[info.cls] += in.size;
+    stats.class_cycles[info.cls] += spent;
+    stats.func_insts[func] += in.size;
+    stats.func_cycles[func] += spent;
+    pc = next;
+    return true;
+}
+
+bool simulate(const Program & prog, const SimOptions & options, SimStats & stats) {
+    Simulator sim(prog, options, stats);
+    return sim.run();
+}
+
+static std::string percent(uint64_t part, uint64_t total) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%5.1f%%", total ? 100.0 * part / total : 0.0);
+    return buf;
+}
+
+void print_report(const Program & prog, const SimStats & stats, std::ostream & os) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", stats.insts ? (double) stats.cycles / stats.insts : 0.0);
+    os << "instructions " << stats.insts << ", cycles " << stats.cycles << ", CPI " << buf << "\n";
+    if (stats.timers)
+        os << "timed (" << stats.timers << " starttime/stoptime): instructions " << stats.timed_insts << ", cycles " << stats.timed_cycles << "\n";
+
+    os << "\n" << std::left << std::setw(24) << "class" << std::right << std::setw(14) << "instructions" << std::setw(14) << "cycles" << "\n";
+    for (int c = 0; c < CLASS_COUNT; ++c)
+        if (stats.class_insts[c])
+            os << std::left << std::setw(24) << class_name((OpClass) c) << std::right << std::setw(14) << stats.class_insts[c]
+               << std::setw(14) << stats.class_cycles[c] << std::setw(8) << percent(stats.class_cycles[c], stats.cycles) << "\n";
+
+    // 函数按花费的周期从多到少排列, 运行时库函数在执行时不花费指令
+    std::vector<int> order;
+    for (size_t f = 0; f < prog.func_names.size(); ++f)
+        if (stats.func_insts[f])
+            order.push_back(f);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return stats.func_cycles[a] > stats.func_cycles[b]; });
+    os << "\n" << std::left << std::setw(24) << "function" << std::right << std::setw(10) << "calls" << std::setw(14) << "instructions"
+       << std::setw(14) << "cycles" << "\n";
+    for (int f : order)
+        os << std::left << std::setw(24) << prog.func_names[f] << std::right << std::setw(10) << stats.func_calls[f] << std::setw(14)
+           << stats.func_insts[f] << std::setw(14) << stats.func_cycles[f] << std::setw(8) << percent(stats.func_cycles[f], stats.cycles) << "\n";
+    for (int k = 0; k < runtime_count(); ++k)
+        if (stats.runtime_calls[k])
+            os << std::left << std::setw(24) << std::string(runtime_name(k)) + " (native)" << std::right << std::setw(10) << stats.runtime_calls[k] << "\n";
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "assembler.h"
+#include <ostream>
+
+// 单发射顺序流水线的代价模型: 各类指令的结果延迟, 乘/除法部件两次发射之间至少间隔的周期数,
+// 以及跳转和成立的分支额外付出的周期数. 向量指令每个周期处理 VLEN / 32 个元素
+struct LatencyModel {
+    int alu = 1, load = 3, mul = 3, div = 20;
+    int mul_interval = 1, div_interval = 20;
+    int taken_branch = 2;
+};
+
+// 预置的模型与编译器 -mtune 的调度模型一致: generic, rocket, sifive-7-series
+bool preset_model(const std::string & name, LatencyModel & model);
+// 按 "load=2,div=10" 的形式修改模型中的项
+bool parse_latency(const std::string & spec, LatencyModel & model);
+
+struct SimOptions {
+    LatencyModel model;
+    uint32_t     memory = 256u << 20; // 字节数, 栈从顶端开始
+    int          vlen   = 128;
+};
+
+struct SimStats {
+    uint64_t insts = 0, cycles = 0;
+    uint64_t class_insts[CLASS_COUNT] = {}, class_cycles[CLASS_COUNT] = {};
+
+    // 按 Program::func_names 的下标; 运行时库函数按编号
+    std::vector<uint64_t> func_calls, func_insts, func_cycles;
+    std::vector<uint64_t> runtime_calls;
+
+    // starttime/stoptime 之间的部分
+    uint64_t timed_insts = 0, timed_cycles = 0;
+    int      timers      = 0;
+
+    int exit_code = 0;
+};
+
+// 从 main 开始执行 prog, 程序的输入输出使用 stdin/stdout. main 返回或 exit 时返回 true,
+// 执行出错 (非法访存, 未知的系统调用等) 时在 stderr 说明原因并返回 false
+bool simulate(const Program & prog, const SimOptions & options, SimStats & stats);
+
+void print_report(const Program & prog, const SimStats & stats, std::ostream & os);
@@ -1,9 +1,33 @@
+#include <algorithm>
+#include <typeinfo>
+
 #include "ast.h"
 
 SymbolList     BaseAST::symbol_list;
 BlockMaker     BaseAST::blocks_list;
 LoopMaintainer BaseAST::loop_list;
 
+std::vector<const void *> BaseAST::outlined_funcs;
+
+std::map<std::string, koopa_raw_function_t> BaseAST::runtime_decls;
+
+// 编译器内部使用的运行时例程 (见 runtime.h) 在第一次调用时才声明
+koopa_raw_function_t BaseAST::runtime_routine(const std::string & name, const std::vector<const void *> & fparams, koopa_raw_type_tag_t ret) {
+    if (runtime_decls.count(name))
+        return runtime_decls[name];
+
+    koopa_raw_function_data_t * func = new koopa_raw_function_data_t();
+    koopa_raw_type_kind_t *     ty   = new koopa_raw_type_kind_t();
+    ty->tag                          = KOOPA_RTT_FUNCTION;
+    ty->data.function.params         = make_koopa_rs_from_vector(fparams, KOOPA_RSIK_TYPE);
+    ty->data.function.ret            = simple_koopa_raw_type_kind(ret);
+    func->ty                         = ty;
+    func->name                       = make_char_arr("@" + name);
+    func->params                     = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    func->bbs                        = empty_koopa_rs(KOOPA_RSIK_BASIC_BLOCK);
+    return runtime_decls[name] = func;
+}
+
 void CompUnitAST::add_lib(std::vector<const void *> & funcs) const {
     koopa_raw_function_data_t * func;
     koopa_raw_type_kind_t *     ty;
@@ -113,4 +137,1007 @@ void CompUnitAST::add_lib(std::vector<const void *> & funcs) const {
     func->bbs                = empty_koopa_rs(KOOPA_RSIK_BASIC_BLOCK);
     symbol_list.addSymbol("stoptime", LValSymbol(LValSymbol::SymbolType::Function, func));
     funcs.push_back(func);
-}
\ No newline at end of file
+}
+
+struct LoopSummary {
+    std::set<std::string> written;
+    bool                  has_call = false;
+    int                   size     = 0;
+};
+
+static void summarize_loop(const BaseAST * ast, LoopSummary & sum) {
+    ++sum.size;
+
+    if (auto assign = dynamic_cast<const AssignStmtAST *>(ast)) {
+        if (auto lval = dynamic_cast<const LValAST *>(assign->lval.get()))
+            sum.written.insert(lval->name);
+    } else if (auto unary = dynamic_cast<const UnaryExpAST *>(ast)) {
+        if (unary->type == UnaryExpAST::UnaryExpType::Function)
+            sum.has_call = true;
+    } else if (auto def = dynamic_cast<const VarDefAST *>(ast))
+        sum.written.insert(def->name);
+    else if (auto def = dynamic_cast<const ConstDefAST *>(ast))
+        sum.written.insert(def->name);
+    else if (auto def = dynamic_cast<const ArrayDefAST *>(ast))
+        sum.written.insert(def->name);
+
+    ast->for_each_child([&](const BaseAST * child) { summarize_loop(child, sum); });
+}
+
+static bool is_loop_invariant(const BaseAST * exp, const LoopSummary & sum) {
+    if (auto unary = dynamic_cast<const UnaryExpAST *>(exp)) {
+        if (unary->type == UnaryExpAST::UnaryExpType::Function)
+            return false;
+    } else if (auto lval = dynamic_cast<const LValAST *>(exp)) {
+        if (! lval->idx.empty() || sum.written.count(lval->name))
+            return false;
+
+        auto var = BaseAST::symbol_list.getSymbol(lval->name);
+        if (var.type == LValSymbol::SymbolType::Const)
+            return true;
+        if (var.type != LValSymbol::SymbolType::Var)
+            return false;
+        return ! sum.has_call || ((koopa_raw_value_t) var.number)->kind.tag != KOOPA_RVT_GLOBAL_ALLOC;
+    }
+
+    bool res = true;
+    exp->for_each_child([&](const BaseAST * child) { res = res && is_loop_invariant(child, sum); });
+    return res;
+}
+
+static const BranchStmtAST * find_invariant_branch(const BaseAST * ast, const LoopSummary & sum) {
+    if (! ast || dynamic_cast<const WhileStmtAST *>(ast))
+        return nullptr;
+
+    if (auto branch = dynamic_cast<const BranchStmtAST *>(ast)) {
+        bool taken;
+        if (BaseAST::loop_list.get_unswitch(branch, taken))
+            return find_invariant_branch(taken ? branch->lval.get() : branch->rval.get(), sum);
+        if (is_loop_invariant(branch->exp.get(), sum))
+            return branch;
+    }
+
+    const BranchStmtAST * res = nullptr;
+    ast->for_each_child([&](const BaseAST * child) {
+        if (! res)
+            res = find_invariant_branch(child, sum);
+    });
+    return res;
+}
+
+const BranchStmtAST * WhileStmtAST::find_unswitch_branch() const {
+    if (! stmt)
+        return nullptr;
+
+    LoopSummary sum;
+    summarize_loop(this, sum);
+
+    if ((sum.size << (loop_list.unswitch_depth() + 1)) > options.unswitch_budget)
+        return nullptr;
+
+    return find_invariant_branch(stmt.get(), sum);
+}
+
+int speculation_cost(const BaseAST * exp, const std::vector<const BaseAST *> & safe_loads) {
+    int cost = 0;
+
+    if (auto unary = dynamic_cast<const UnaryExpAST *>(exp)) {
+        if (unary->type == UnaryExpAST::UnaryExpType::Function)
+            return -1;
+        if (unary->type == UnaryExpAST::UnaryExpType::UnaryExp && unary->op != "+")
+            cost = 1;
+    } else if (auto lval = dynamic_cast<const LValAST *>(exp)) {
+        auto var = BaseAST::symbol_list.getSymbol(lval->name);
+        if (var.type == LValSymbol::SymbolType::Const)
+            return 0;
+        if (var.type == LValSymbol::SymbolType::Var)
+            return 1;
+        if (lval->idx.empty())
+            return -1;
+
+        bool safe = false;
+        for (auto load : safe_loads)
+            safe = safe || same_ast(lval, load);
+        if (! safe)
+            return -1;
+        cost = 1 + lval->idx.size();
+    } else if (auto mul = dynamic_cast<const MulExpAST *>(exp)) {
+        if (mul->type == MulExpAST::MulExpType::Binary) {
+            if (mul->op != "*")
+                return -1;
+            cost = 1;
+        }
+    } else if (auto add = dynamic_cast<const AddExpAST *>(exp))
+        cost = add->type == AddExpAST::AddExpType::Binary;
+    else if (auto rel = dynamic_cast<const RelExpAST *>(exp))
+        cost = rel->type == RelExpAST::RelExpType::Binary;
+    else if (auto eq = dynamic_cast<const EqExpAST *>(exp))
+        cost = eq->type == EqExpAST::EqExpType::Binary;
+    else if (auto land = dynamic_cast<const LAndExpAST *>(exp))
+        cost = land->type == LAndExpAST::LAndExpType::Binary ? 3 : 0;
+    else if (auto lor = dynamic_cast<const LOrExpAST *>(exp))
+        cost = lor->type == LOrExpAST::LOrExpType::Binary ? 3 : 0;
+
+    exp->for_each_child([&](const BaseAST * child) {
+        if (cost < 0)
+            return;
+        int sub = speculation_cost(child, safe_loads);
+        cost    = sub < 0 ? -1 : cost + sub;
+    });
+    return cost;
+}
+
+bool can_speculate(const BaseAST * exp) {
+    int cost = speculation_cost(exp);
+    return cost >= 0 && cost <= options.if_conversion_cost;
+}
+
+bool same_ast(const BaseAST * a, const BaseAST * b) {
+    if (! a || ! b)
+        return a == b;
+    if (typeid(*a) != typeid(*b))
+        return false;
+
+    if (auto lval = dynamic_cast<const LValAST *>(a)) {
+        if (lval->name != ((const LValAST *) b)->name)
+            return false;
+    } else if (auto primary = dynamic_cast<const PrimaryExpAST *>(a)) {
+        auto other = (const PrimaryExpAST *) b;
+        if (primary->type != other->type || (primary->type == PrimaryExpAST::PrimaryExpType::Number && primary->number != other->number))
+            return false;
+    } else if (auto unary = dynamic_cast<const UnaryExpAST *>(a)) {
+        if (unary->type != ((const UnaryExpAST *) b)->type || unary->op != ((const UnaryExpAST *) b)->op)
+            return false;
+    } else if (auto mul = dynamic_cast<const MulExpAST *>(a)) {
+        if (mul->type != ((const MulExpAST *) b)->type || mul->op != ((const MulExpAST *) b)->op)
+            return false;
+    } else if (auto add = dynamic_cast<const AddExpAST *>(a)) {
+        if (add->type != ((const AddExpAST *) b)->type || add->op != ((const AddExpAST *) b)->op)
+            return false;
+    } else if (auto rel = dynamic_cast<const RelExpAST *>(a)) {
+        if (rel->type != ((const RelExpAST *) b)->type || rel->op != ((const RelExpAST *) b)->op)
+            return false;
+    } else if (auto eq = dynamic_cast<const EqExpAST *>(a)) {
+        if (eq->type != ((const EqExpAST *) b)->type || eq->op != ((const EqExpAST *) b)->op)
+            return false;
+    } else if (auto land = dynamic_cast<const LAndExpAST *>(a)) {
+        if (land->type != ((const LAndExpAST *) b)->type)
+            return false;
+    } else if (auto lor = dynamic_cast<const LOrExpAST *>(a)) {
+        if (lor->type != ((const LOrExpAST *) b)->type)
+            return false;
+    }
+
+    std::vector<const BaseAST *> ca, cb;
+    a->for_each_child([&](const BaseAST * child) { ca.push_back(child); });
+    b->for_each_child([&](const BaseAST * child) { cb.push_back(child); });
+    if (ca.size() != cb.size())
+        return false;
+    for (size_t i = 0; i < ca.size(); ++i)
+        if (! same_ast(ca[i], cb[i]))
+            return false;
+    return true;
+}
+
+static void collect_names(const BaseAST * ast, std::set<std::string> & names) {
+    if (auto lval = dynamic_cast<const LValAST *>(ast))
+        names.insert(lval->name);
+    ast->for_each_child([&](const BaseAST * child) { collect_names(child, names); });
+}
+
+// 只收集一定会执行的读取: && 与 || 的右侧可能被短路, 只看左侧
+static void collect_array_loads(const BaseAST * ast, std::vector<const BaseAST *> & loads) {
+    if (auto lval = dynamic_cast<const LValAST *>(ast))
+        if (! lval->idx.empty())
+            loads.push_back(lval);
+    if (auto land = dynamic_cast<const LAndExpAST *>(ast))
+        if (land->type == LAndExpAST::LAndExpType::Binary)
+            return collect_array_loads(land->left_exp.get(), loads);
+    if (auto lor = dynamic_cast<const LOrExpAST *>(ast))
+        if (lor->type == LOrExpAST::LOrExpType::Binary)
+            return collect_array_loads(lor->left_exp.get(), loads);
+    ast->for_each_child([&](const BaseAST * child) { collect_array_loads(child, loads); });
+}
+
+// 分支的一侧只能由若干赋值语句组成
+static bool collect_arm(const BaseAST * stmt, std::vector<const AssignStmtAST *> & arm) {
+    if (! stmt)
+        return true;
+    if (auto assign = dynamic_cast<const AssignStmtAST *>(stmt)) {
+        arm.push_back(assign);
+        return true;
+    }
+    if (auto block = dynamic_cast<const BlockAST *>(stmt)) {
+        for (const auto & it : block->insts)
+            if (! collect_arm(it.get(), arm))
+                return false;
+        return true;
+    }
+    return false;
+}
+
+// 两侧的赋值都在分支前的状态下求值, 因此同侧中不能读取先前语句写过的变量
+static int arm_cost(const std::vector<const AssignStmtAST *> & arm, const std::vector<const AssignStmtAST *> & other, const std::vector<const BaseAST *> & safe_loads) {
+    std::set<std::string> written;
+    int                   cost = 0;
+
+    for (auto assign : arm) {
+        auto lval = (const LValAST *) assign->lval.get();
+        auto var  = BaseAST::symbol_list.getSymbol(lval->name);
+
+        std::set<std::string> names;
+        collect_names(assign, names);
+        for (const auto & name : names)
+            if (written.count(name))
+                return -1;
+        written.insert(lval->name);
+
+        if (lval->idx.empty()) {
+            if (var.type != LValSymbol::SymbolType::Var)
+                return -1;
+        } else {
+            bool paired = false;
+            for (auto it : other)
+                paired = paired || same_ast(lval, it->lval.get());
+            if (! paired)
+                return -1;
+            for (const auto & idx : lval->idx) {
+                int sub = speculation_cost(idx.get(), safe_loads);
+                if (sub < 0)
+                    return -1;
+                cost += sub;
+            }
+        }
+
+        int sub = speculation_cost(assign->exp.get(), safe_loads);
+        if (sub < 0)
+            return -1;
+        cost += sub + 3;
+    }
+    return cost;
+}
+
+bool BranchStmtAST::if_convert() const {
+    std::vector<const AssignStmtAST *> then_arm, else_arm;
+    if (! collect_arm(lval.get(), then_arm) || ! collect_arm(rval.get(), else_arm))
+        return false;
+    if (then_arm.empty() && else_arm.empty())
+        return false;
+
+    std::vector<const BaseAST *> safe_loads;
+    collect_array_loads(exp.get(), safe_loads);
+
+    int then_cost = arm_cost(then_arm, else_arm, safe_loads);
+    int else_cost = arm_cost(else_arm, then_arm, safe_loads);
+    if (then_cost < 0 || else_cost < 0 || then_cost + else_cost > options.if_conversion_cost * 2)
+        return false;
+
+    // res = else ^ ((then ^ else) & -cond)
+    koopa_raw_value_data * cond = make_binary(KOOPA_RBO_NOT_EQ, (koopa_raw_value_t) exp->to_koopa_item(), make_number_koopa(0));
+    koopa_raw_value_data * mask = make_binary(KOOPA_RBO_SUB, make_number_koopa(0), cond);
+    blocks_list.addInst(cond);
+    blocks_list.addInst(mask);
+
+    struct Target {
+        const LValAST *   lval;
+        koopa_raw_value_t then_val;
+        koopa_raw_value_t else_val;
+    };
+    std::vector<Target> targets;
+
+    auto find_target = [&](const AssignStmtAST * assign) -> Target & {
+        for (auto & t : targets)
+            if (same_ast(t.lval, assign->lval.get()))
+                return t;
+        targets.push_back({ (const LValAST *) assign->lval.get(), nullptr, nullptr });
+        return targets.back();
+    };
+    for (auto assign : then_arm) {
+        auto val                     = (koopa_raw_value_t) assign->exp->to_koopa_item();
+        find_target(assign).then_val = val;
+    }
+    for (auto assign : else_arm) {
+        auto val                     = (koopa_raw_value_t) assign->exp->to_koopa_item();
+        find_target(assign).else_val = val;
+    }
+
+    std::vector<koopa_raw_value_t> results;
+    for (auto & t : targets) {
+        if (! t.then_val)
+            t.then_val = (koopa_raw_value_t) t.lval->to_koopa_item();
+        if (! t.else_val)
+            t.else_val = (koopa_raw_value_t) t.lval->to_koopa_item();
+
+        koopa_raw_value_data * diff = make_binary(KOOPA_RBO_XOR, t.then_val, t.else_val);
+        koopa_raw_value_data * pick = make_binary(KOOPA_RBO_AND, diff, mask);
+        koopa_raw_value_data * res  = make_binary(KOOPA_RBO_XOR, t.else_val, pick);
+        blocks_list.addInst(diff);
+        blocks_list.addInst(pick);
+        blocks_list.addInst(res);
+        results.push_back(res);
+    }
+
+    std::vector<koopa_raw_value_t> dests;
+    for (auto & t : targets)
+        dests.push_back((koopa_raw_value_t) t.lval->build_left_value());
+    for (size_t i = 0; i < targets.size(); ++i)
+        blocks_list.addInst(make_store(results[i], dests[i]));
+    return true;
+}
+
+// for (i = 0; i < n; ++i) base[i] = 0;
+void ArrayDefAST::zero_fill(koopa_raw_value_t base, int n) const {
+    koopa_raw_value_data * idx = make_alloc_int("%" + name + "_i");
+    blocks_list.addInst(idx);
+    blocks_list.addInst(make_store(make_number_koopa(0), idx));
+
+    koopa_raw_basic_block_data_t * entry = make_block("%" + name + "_zero_entry");
+    koopa_raw_basic_block_data_t * body  = make_block("%" + name + "_zero_body");
+    koopa_raw_basic_block_data_t * end   = make_block("%" + name + "_zero_end");
+
+    blocks_list.addInst(make_jump_block(entry));
+    blocks_list.addBlock(entry);
+    koopa_raw_value_data * i = make_load(idx);
+    blocks_list.addInst(i);
+    koopa_raw_value_data * cond = make_binary(KOOPA_RBO_LT, i, make_number_koopa(n));
+    blocks_list.addInst(cond);
+    blocks_list.addInst(make_branch(cond, body, end));
+
+    blocks_list.addBlock(body);
+    koopa_raw_value_data * ptr = set_ptr(base, i, false, KOOPA_RVT_GET_PTR);
+    blocks_list.addInst(ptr);
+    blocks_list.addInst(make_store(make_number_koopa(0), ptr));
+    koopa_raw_value_data * next = make_binary(KOOPA_RBO_ADD, i, make_number_koopa(1));
+    blocks_list.addInst(next);
+    blocks_list.addInst(make_store(next, idx));
+    blocks_list.addInst(make_jump_block(entry));
+
+    blocks_list.addBlock(end);
+}
+
+// 去掉只有一个子结点的表达式包装, 如 ExpAST, 单目的 AddExpAST 等
+static const BaseAST * strip(const BaseAST * exp) {
+    while (true) {
+        if (auto e = dynamic_cast<const ExpAST *>(exp))
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const LOrExpAST *>(exp); e && e->type == LOrExpAST::LOrExpType::Unary)
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const LAndExpAST *>(exp); e && e->type == LAndExpAST::LAndExpType::Unary)
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const EqExpAST *>(exp); e && e->type == EqExpAST::EqExpType::Unary)
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const RelExpAST *>(exp); e && e->type == RelExpAST::RelExpType::Unary)
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const AddExpAST *>(exp); e && e->type == AddExpAST::AddExpType::Unary)
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const MulExpAST *>(exp); e && e->type == MulExpAST::MulExpType::Unary)
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const UnaryExpAST *>(exp); e && e->type == UnaryExpAST::UnaryExpType::PrimaryExp)
+            exp = e->exp.get();
+        else if (auto e = dynamic_cast<const PrimaryExpAST *>(exp); e && e->type != PrimaryExpAST::PrimaryExpType::Number)
+            exp = e->exp.get();
+        else
+            return exp;
+    }
+}
+
+static bool is_const_exp(const BaseAST * exp) {
+    if (auto unary = dynamic_cast<const UnaryExpAST *>(exp)) {
+        if (unary->type == UnaryExpAST::UnaryExpType::Function)
+            return false;
+    } else if (auto lval = dynamic_cast<const LValAST *>(exp))
+        return lval->idx.empty() && BaseAST::symbol_list.getSymbol(lval->name).type == LValSymbol::SymbolType::Const;
+
+    bool res = true;
+    exp->for_each_child([&](const BaseAST * child) { res = res && is_const_exp(child); });
+    return res;
+}
+
+// 不带下标的普通变量名, 否则返回空串
+static std::string scalar_name(const BaseAST * exp) {
+    auto lval = dynamic_cast<const LValAST *>(strip(exp));
+    if (! lval || ! lval->idx.empty() || BaseAST::symbol_list.getSymbol(lval->name).type != LValSymbol::SymbolType::Var)
+        return "";
+    return lval->name;
+}
+
+// 数组 (或数组参数) 的维数, 不是数组时返回 -1
+static int array_dims(const std::string & name) {
+    auto var = BaseAST::symbol_list.getSymbol(name);
+    if (var.type != LValSymbol::SymbolType::Array && var.type != LValSymbol::SymbolType::Pointer)
+        return -1;
+
+    koopa_raw_type_t ty   = ((koopa_raw_value_t) var.number)->ty->data.pointer.base;
+    int              dims = 0;
+    if (var.type == LValSymbol::SymbolType::Pointer) {
+        ty = ty->data.pointer.base;
+        ++dims;
+    }
+    while (ty->tag == KOOPA_RTT_ARRAY) {
+        ty = ty->data.array.base;
+        ++dims;
+    }
+    return dims;
+}
+
+// a[..][v + c]: 访问单个元素, 前面的下标与循环无关, 最后一维随某个归纳变量 v 递增
+static bool is_unit_stride(const BaseAST * exp, const std::set<std::string> & ivars, const LoopSummary & sum) {
+    auto lval = dynamic_cast<const LValAST *>(strip(exp));
+    if (! lval || lval->idx.empty() || array_dims(lval->name) != (int) lval->idx.size())
+        return false;
+
+    for (size_t i = 0; i + 1 < lval->idx.size(); ++i)
+        if (! is_loop_invariant(lval->idx[i].get(), sum))
+            return false;
+
+    const BaseAST * last = strip(lval->idx.back().get());
+    if (ivars.count(scalar_name(last)))
+        return true;
+
+    auto add = dynamic_cast<const AddExpAST *>(last);
+    if (! add || add->type != AddExpAST::AddExpType::Binary)
+        return false;
+    if (ivars.count(scalar_name(add->left_exp.get())) && is_const_exp(add->exp.get()))
+        return true;
+    return add->op == "+" && is_const_exp(add->left_exp.get()) && ivars.count(scalar_name(add->exp.get()));
+}
+
+// a[..][i] = b[..][k] op c 的向量化: kernel(dst, b, c, n), c 是数组或循环不变量
+struct VectorOp {
+    const char *    kernel = nullptr;
+    const BaseAST * vec;
+    const BaseAST * other;
+    bool            negate = false; // b - x 用 b + (0 - x) 完成
+};
+
+static bool match_vector_op(const BaseAST * exp, const std::set<std::string> & ivars, const LoopSummary & sum, VectorOp & vop) {
+    const BaseAST * lhs, * rhs;
+    std::string     op;
+    if (auto add = dynamic_cast<const AddExpAST *>(exp); add && add->type == AddExpAST::AddExpType::Binary) {
+        lhs = add->left_exp.get();
+        rhs = add->exp.get();
+        op  = add->op;
+    } else if (auto mul = dynamic_cast<const MulExpAST *>(exp); mul && mul->type == MulExpAST::MulExpType::Binary && mul->op == "*") {
+        lhs = mul->left_exp.get();
+        rhs = mul->exp.get();
+        op  = mul->op;
+    } else
+        return false;
+
+    bool lvec = is_unit_stride(lhs, ivars, sum), rvec = is_unit_stride(rhs, ivars, sum);
+    if (lvec && rvec) {
+        vop.kernel = op == "+" ? "__sysy_vadd_vv" : op == "-" ? "__sysy_vsub_vv" : "__sysy_vmul_vv";
+        vop.vec    = lhs;
+        vop.other  = rhs;
+    } else if (lvec && is_loop_invariant(rhs, sum)) {
+        vop.kernel = op == "*" ? "__sysy_vmul_vx" : "__sysy_vadd_vx";
+        vop.vec    = lhs;
+        vop.other  = rhs;
+        vop.negate = op == "-";
+    } else if (rvec && is_loop_invariant(lhs, sum)) {
+        vop.kernel = op == "+" ? "__sysy_vadd_vx" : op == "-" ? "__sysy_vrsub_vx" : "__sysy_vmul_vx";
+        vop.vec    = rhs;
+        vop.other  = lhs;
+    } else
+        return false;
+    return true;
+}
+
+// 识别
+//     while (i < n) { a[..][i + c] = b[..][k + d]; i = i + 1; k = k + 1; }
+//     while (i < n) { a[..][i + c] = x; i = i + 1; }
+// 并改写为一次 __sysy_memcpy / __sysy_memset 调用. 启用 V 扩展时还识别
+//     while (i < n) { a[..][i] = b[..][k] op c; ... }     op 为 + - *, c 是数组或循环不变量
+//     while (i < n) { s = s + b[..][k]; ... }
+// 改写为向量化例程的调用; 例程在 dst 与源数组交错重叠时退回逐个计算
+bool WhileStmtAST::lower_mem_idiom() const {
+    auto rel = dynamic_cast<const RelExpAST *>(strip(exp.get()));
+    if (! rel || rel->type != RelExpAST::RelExpType::Binary || rel->op != "<")
+        return false;
+
+    std::vector<const AssignStmtAST *> body;
+    if (! collect_arm(stmt.get(), body) || body.size() < 2)
+        return false;
+
+    std::set<std::string> ivars;
+    for (size_t i = 1; i < body.size(); ++i) {
+        std::string v   = scalar_name(body[i]->lval.get());
+        auto        add = dynamic_cast<const AddExpAST *>(strip(body[i]->exp.get()));
+        if (v.empty() || ivars.count(v) || ! add || add->type != AddExpAST::AddExpType::Binary || add->op != "+")
+            return false;
+        if (scalar_name(add->left_exp.get()) != v || ! is_const_exp(add->exp.get()) || add->exp->get_value() != 1)
+            return false;
+        ivars.insert(v);
+    }
+
+    std::string bound_var = scalar_name(rel->left_exp.get());
+    if (! ivars.count(bound_var))
+        return false;
+
+    LoopSummary sum;
+    summarize_loop(this, sum);
+    if (! is_loop_invariant(rel->exp.get(), sum))
+        return false;
+
+    const AssignStmtAST * assign = body[0];
+    const BaseAST *       exp    = strip(assign->exp.get());
+    std::string           acc    = scalar_name(assign->lval.get());
+
+    VectorOp        vop;
+    const BaseAST * reduced = nullptr;
+    bool            copy    = false;
+    if (is_unit_stride(assign->lval.get(), ivars, sum)) {
+        copy = is_unit_stride(exp, ivars, sum);
+        if (! copy && ! is_loop_invariant(exp, sum) && ! (options.rvv && match_vector_op(exp, ivars, sum, vop)))
+            return false;
+    } else if (options.rvv && ! acc.empty() && ! ivars.count(acc)) {
+        auto add = dynamic_cast<const AddExpAST *>(exp);
+        if (! add || add->type != AddExpAST::AddExpType::Binary || add->op != "+")
+            return false;
+        if (scalar_name(add->left_exp.get()) == acc && is_unit_stride(add->exp.get(), ivars, sum))
+            reduced = add->exp.get();
+        else if (scalar_name(add->exp.get()) == acc && is_unit_stride(add->left_exp.get(), ivars, sum))
+            reduced = add->left_exp.get();
+        else
+            return false;
+    } else
+        return false;
+
+    koopa_raw_basic_block_data_t * body_block = make_block("%mem_idiom_" + std::to_string(while_id));
+    koopa_raw_basic_block_data_t * end_block  = make_block("%end_" + std::to_string(while_id));
+
+    koopa_raw_value_t      iv    = (koopa_raw_value_t) rel->left_exp->to_koopa_item();
+    koopa_raw_value_t      bound = (koopa_raw_value_t) rel->exp->to_koopa_item();
+    koopa_raw_value_data * cond  = make_binary(KOOPA_RBO_LT, iv, bound);
+    blocks_list.addInst(cond);
+    blocks_list.addInst(make_branch(cond, body_block, end_block));
+
+    blocks_list.addBlock(body_block);
+    koopa_raw_value_data * n = make_binary(KOOPA_RBO_SUB, bound, iv);
+    blocks_list.addInst(n);
+
+    auto dst = (koopa_raw_value_t) ((const LValAST *) strip(assign->lval.get()))->build_left_value();
+    if (reduced) {
+        auto src    = (koopa_raw_value_t) ((const LValAST *) strip(reduced))->build_left_value();
+        auto vsum   = runtime_routine("__sysy_vsum", { make_int_pointer_type(), simple_koopa_raw_type_kind(KOOPA_RTT_INT32) }, KOOPA_RTT_INT32);
+        auto part   = make_call(vsum, { src, n });
+        auto result = make_binary(KOOPA_RBO_ADD, (koopa_raw_value_t) assign->lval->to_koopa_item(), part);
+        blocks_list.addInst(part);
+        blocks_list.addInst(result);
+        blocks_list.addInst(make_store(result, dst));
+    } else if (vop.kernel) {
+        auto src = (koopa_raw_value_t) ((const LValAST *) strip(vop.vec))->build_left_value();
+        koopa_raw_value_t other;
+        bool              vv = is_unit_stride(vop.other, ivars, sum);
+        if (vv)
+            other = (koopa_raw_value_t) ((const LValAST *) strip(vop.other))->build_left_value();
+        else {
+            other = (koopa_raw_value_t) vop.other->to_koopa_item();
+            if (vop.negate) {
+                auto neg = make_binary(KOOPA_RBO_SUB, make_number_koopa(0), other);
+                blocks_list.addInst(neg);
+                other = neg;
+            }
+        }
+        auto kernel = runtime_routine(vop.kernel, { make_int_pointer_type(), make_int_pointer_type(), vv ? make_int_pointer_type() : simple_koopa_raw_type_kind(KOOPA_RTT_INT32), simple_koopa_raw_type_kind(KOOPA_RTT_INT32) });
+        blocks_list.addInst(make_call(kernel, { dst, src, other, n }));
+    } else if (copy) {
+        auto src    = (koopa_raw_value_t) ((const LValAST *) strip(assign->exp.get()))->build_left_value();
+        auto memcpy = runtime_routine("__sysy_memcpy", { make_int_pointer_type(), make_int_pointer_type(), simple_koopa_raw_type_kind(KOOPA_RTT_INT32) });
+        blocks_list.addInst(make_call(memcpy, { dst, src, n }));
+    } else {
+        auto value  = (koopa_raw_value_t) assign->exp->to_koopa_item();
+        auto memset = runtime_routine("__sysy_memset", { make_int_pointer_type(), simple_koopa_raw_type_kind(KOOPA_RTT_INT32), simple_koopa_raw_type_kind(KOOPA_RTT_INT32) });
+        blocks_list.addInst(make_call(memset, { dst, value, n }));
+    }
+
+    for (size_t i = 1; i < body.size(); ++i) {
+        auto lval = (const LValAST *) strip(body[i]->lval.get());
+        auto next = make_binary(KOOPA_RBO_ADD, (koopa_raw_value_t) lval->to_koopa_item(), n);
+        blocks_list.addInst(next);
+        blocks_list.addInst(make_store(next, (koopa_raw_value_t) lval->build_left_value()));
+    }
+    blocks_list.addInst(make_jump_block(end_block));
+
+    blocks_list.addBlock(end_block);
+    return true;
+}
+
+static void collect_lvals(const BaseAST * ast, std::vector<const LValAST *> & lvals) {
+    if (auto lval = dynamic_cast<const LValAST *>(ast))
+        lvals.push_back(lval);
+    ast->for_each_child([&](const BaseAST * child) { collect_lvals(child, lvals); });
+}
+
+// 把循环体提取为 void @__sysy_doall_N(lo, hi, 捕获的变量...), 其中执行 iv 从 lo 到 hi 的迭代.
+// 捕获的标量按值传入, 数组按首元素指针传入, 在新函数中以同名的变量/数组参数出现
+static koopa_raw_function_t outline_loop(const std::vector<const AssignStmtAST *> & body, const std::string & iv, const std::vector<std::string> & captures, const std::vector<const void *> & args) {
+    static int count = 0;
+
+    BlockMaker saved = BaseAST::blocks_list;
+    auto &     bl    = BaseAST::blocks_list;
+    auto &     sl    = BaseAST::symbol_list;
+
+    std::string name = "__sysy_doall_" + std::to_string(count++);
+    auto        func = new koopa_raw_function_data_t();
+    auto        ty   = new koopa_raw_type_kind_t();
+
+    std::vector<const void *> types, params;
+    for (size_t i = 0; i < args.size(); ++i) {
+        auto param                          = new koopa_raw_value_data();
+        param->ty                           = ((koopa_raw_value_t) args[i])->ty;
+        param->name                         = make_char_arr("@" + (i == 0 ? iv : i == 1 ? iv + "_end" : captures[i - 2]));
+        param->used_by                      = empty_koopa_rs(KOOPA_RSIK_VALUE);
+        param->kind.tag                     = KOOPA_RVT_FUNC_ARG_REF;
+        param->kind.data.func_arg_ref.index = i;
+        types.push_back(param->ty);
+        params.push_back(param);
+    }
+    ty->tag                  = KOOPA_RTT_FUNCTION;
+    ty->data.function.params = make_koopa_rs_from_vector(types, KOOPA_RSIK_TYPE);
+    ty->data.function.ret    = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
+    func->ty                 = ty;
+    func->name               = make_char_arr("@" + name);
+    func->params             = make_koopa_rs_from_vector(params, KOOPA_RSIK_VALUE);
+
+    std::vector<const void *> blocks;
+    bl.insts_buf.clear();
+    bl.setBlockBuf(&blocks);
+    bl.addBlock(make_block("%entry_" + name));
+    bl.setFunc(func);
+    sl.newEnv();
+
+    std::vector<koopa_raw_value_t> allocs;
+    for (size_t i = 0; i < params.size(); ++i) {
+        auto param = (koopa_raw_value_t) params[i];
+        auto alloc = make_alloc_type(param->name, param->ty);
+        bl.addInst(alloc);
+        bl.addInst(make_store(param, alloc));
+        allocs.push_back(alloc);
+        if (i == 0)
+            sl.addSymbol(iv, LValSymbol(LValSymbol::SymbolType::Var, alloc));
+        else if (i >= 2)
+            sl.addSymbol(captures[i - 2], LValSymbol(param->ty->tag == KOOPA_RTT_POINTER ? LValSymbol::SymbolType::Pointer : LValSymbol::SymbolType::Var, alloc));
+    }
+
+    auto cond_block = make_block("%doall_cond");
+    auto body_block = make_block("%doall_body");
+    auto end_block  = make_block("%doall_end");
+    bl.addInst(make_jump_block(cond_block));
+
+    bl.addBlock(cond_block);
+    auto i    = make_load(allocs[0]);
+    auto end  = make_load(allocs[1]);
+    auto cond = make_binary(KOOPA_RBO_LT, i, end);
+    bl.addInst(i);
+    bl.addInst(end);
+    bl.addInst(cond);
+    bl.addInst(make_branch(cond, body_block, end_block));
+
+    bl.addBlock(body_block);
+    for (auto assign : body)
+        assign->to_koopa_item();
+    bl.addInst(make_jump_block(cond_block));
+
+    bl.addBlock(end_block);
+    sl.deleteEnv();
+    bl.finishBlock();
+    func->bbs = make_koopa_rs_from_vector(blocks, KOOPA_RSIK_BASIC_BLOCK);
+
+    BaseAST::blocks_list = saved;
+    BaseAST::outlined_funcs.push_back(func);
+    return func;
+}
+
+// 识别 DOALL 循环
+//     while (i < n) { a[..][i] = ...; b[..][i] = ...; i = i + 1; }
+// 其中只有 i 和以 [不变量..][i] 访问的数组元素被写, 被写的数组在循环中也只以这种方式访问, 没有调用.
+// 数组参数可能指向调用者的任何数组, 它与全局数组或其他数组参数同时出现且其中之一被写时不做并行化.
+// 改写为对提取出的函数的调用, 后端把它交给运行时的线程池 (__sysy_parallel_for) 分段执行
+bool WhileStmtAST::parallelize() const {
+    auto rel = dynamic_cast<const RelExpAST *>(strip(exp.get()));
+    if (! rel || rel->type != RelExpAST::RelExpType::Binary || rel->op != "<")
+        return false;
+
+    std::vector<const AssignStmtAST *> body;
+    if (! collect_arm(stmt.get(), body) || body.size() < 2)
+        return false;
+
+    std::string iv   = scalar_name(rel->left_exp.get());
+    auto        step = dynamic_cast<const AddExpAST *>(strip(body.back()->exp.get()));
+    if (iv.empty() || scalar_name(body.back()->lval.get()) != iv || ! step || step->type != AddExpAST::AddExpType::Binary || step->op != "+")
+        return false;
+    if (scalar_name(step->left_exp.get()) != iv || ! is_const_exp(step->exp.get()) || step->exp->get_value() != 1)
+        return false;
+
+    LoopSummary sum;
+    summarize_loop(this, sum);
+    if (sum.has_call || ! is_loop_invariant(rel->exp.get(), sum))
+        return false;
+
+    std::set<std::string> written;
+    for (size_t k = 0; k + 1 < body.size(); ++k) {
+        auto lval = dynamic_cast<const LValAST *>(body[k]->lval.get());
+        if (! lval || lval->idx.empty())
+            return false;
+        written.insert(lval->name);
+    }
+
+    std::vector<const LValAST *> lvals;
+    for (auto assign : body)
+        collect_lvals(assign, lvals);
+
+    std::map<std::string, LValSymbol> arrays;
+    std::vector<std::string>          captures;
+    for (auto lval : lvals) {
+        if (lval->name == iv)
+            continue;
+        auto var = symbol_list.getSymbol(lval->name);
+        if (var.type == LValSymbol::SymbolType::Const)
+            continue;
+        if (var.type == LValSymbol::SymbolType::Array || var.type == LValSymbol::SymbolType::Pointer) {
+            if (array_dims(lval->name) != (int) lval->idx.size())
+                return false;
+            if (written.count(lval->name)) {
+                if (scalar_name(lval->idx.back().get()) != iv)
+                    return false;
+                for (size_t k = 0; k + 1 < lval->idx.size(); ++k)
+                    if (! is_loop_invariant(lval->idx[k].get(), sum))
+                        return false;
+            }
+            arrays[lval->name] = var;
+        } else if (var.type != LValSymbol::SymbolType::Var)
+            return false;
+
+        if (((koopa_raw_value_t) var.number)->kind.tag != KOOPA_RVT_GLOBAL_ALLOC && std::find(captures.begin(), captures.end(), lval->name) == captures.end())
+            captures.push_back(lval->name);
+    }
+    // 参数传递只用 a0-a7: 范围占两个, 其余的留给捕获的变量
+    if (captures.size() > 6)
+        return false;
+
+    auto is_pointer = [](const LValSymbol & var) { return var.type == LValSymbol::SymbolType::Pointer; };
+    auto is_global  = [](const LValSymbol & var) { return var.type == LValSymbol::SymbolType::Array && ((koopa_raw_value_t) var.number)->kind.tag == KOOPA_RVT_GLOBAL_ALLOC; };
+    for (auto & [u, su] : arrays)
+        for (auto & [v, sv] : arrays)
+            if (u != v && written.count(u) && ((is_pointer(su) && (is_pointer(sv) || is_global(sv))) || (is_pointer(sv) && is_global(su))))
+                return false;
+
+    koopa_raw_basic_block_data_t * body_block = make_block("%doall_" + std::to_string(while_id));
+    koopa_raw_basic_block_data_t * end_block  = make_block("%end_" + std::to_string(while_id));
+
+    koopa_raw_value_t      first = (koopa_raw_value_t) rel->left_exp->to_koopa_item();
+    koopa_raw_value_t      bound = (koopa_raw_value_t) rel->exp->to_koopa_item();
+    koopa_raw_value_data * cond  = make_binary(KOOPA_RBO_LT, first, bound);
+    blocks_list.addInst(cond);
+    blocks_list.addInst(make_branch(cond, body_block, end_block));
+
+    blocks_list.addBlock(body_block);
+    std::vector<const void *> args = { first, bound };
+    for (const auto & name : captures) {
+        auto var   = symbol_list.getSymbol(name);
+        auto alloc = (koopa_raw_value_t) var.number;
+        auto arg   = var.type == LValSymbol::SymbolType::Array ? set_ptr(alloc) : make_load(alloc);
+        blocks_list.addInst(arg);
+        args.push_back(arg);
+    }
+    auto worker = outline_loop(body, iv, captures, args);
+    blocks_list.addInst(make_call(worker, args));
+    blocks_list.addInst(make_store(bound, (koopa_raw_value_t) ((const LValAST *) strip(rel->left_exp.get()))->build_left_value()));
+    blocks_list.addInst(make_jump_block(end_block));
+
+    blocks_list.addBlock(end_block);
+    return true;
+}
+
+void BlockAST::emit_insts() const {
+    for (size_t i = 0; i < insts.size(); ++i) {
+        auto def = dynamic_cast<const ArrayDefAST *>(insts[i].get());
+        if (def && def->can_scalarize(insts, i + 1))
+            def->scalarize();
+        else
+            insts[i]->to_koopa_item();
+    }
+}
+
+static void collect_decls(const BaseAST * ast, std::set<std::string> & names) {
+    if (! ast)
+        return;
+
+    if (auto def = dynamic_cast<const VarDefAST *>(ast))
+        names.insert(def->name);
+    else if (auto def = dynamic_cast<const ConstDefAST *>(ast))
+        names.insert(def->name);
+    else if (auto def = dynamic_cast<const ArrayDefAST *>(ast))
+        names.insert(def->name);
+
+    ast->for_each_child([&](const BaseAST * child) { collect_decls(child, names); });
+}
+
+// later: 作用域中在数组之后才声明的名字, 此时还不在符号表里, 不能当作常量求值
+static bool only_const_indexed(const std::string & name, const std::vector<int> & sz, const std::set<std::string> & later, const BaseAST * ast) {
+    if (! ast)
+        return true;
+
+    if (auto lval = dynamic_cast<const LValAST *>(ast); lval && lval->name == name) {
+        if (lval->idx.size() != sz.size())
+            return false;
+        for (size_t i = 0; i < sz.size(); ++i) {
+            std::set<std::string> names;
+            collect_names(lval->idx[i].get(), names);
+            for (const auto & n : names)
+                if (later.count(n))
+                    return false;
+            if (! is_const_exp(lval->idx[i].get()))
+                return false;
+            int v = ((const ValueBaseAST *) lval->idx[i].get())->get_value();
+            if (v < 0 || v >= sz[i])
+                return false;
+        }
+        return true;
+    }
+
+    bool res = true;
+    ast->for_each_child([&](const BaseAST * child) { res = res && only_const_indexed(name, sz, later, child); });
+    return res;
+}
+
+bool ArrayDefAST::can_scalarize(const std::vector<std::unique_ptr<BaseAST>> & scope, size_t from) const {
+    if (! options.sroa)
+        return false;
+
+    int total_size = 1;
+
+    std::vector<int> sz;
+    for (const auto & e : sz_exp) {
+        sz.push_back(e->get_value());
+        total_size *= sz.back();
+    }
+    if (total_size > options.sroa_max_size)
+        return false;
+
+    std::set<std::string> later;
+    for (size_t i = from; i < scope.size(); ++i)
+        collect_decls(scope[i].get(), later);
+
+    for (size_t i = from; i < scope.size(); ++i)
+        if (! only_const_indexed(name, sz, later, scope[i].get()))
+            return false;
+    return true;
+}
+
+void ArrayDefAST::scalarize() const {
+    ScalarArray * arr = new ScalarArray();
+
+    int total_size = 1;
+    for (const auto & e : sz_exp) {
+        arr->sz.push_back(e->get_value());
+        total_size *= arr->sz.back();
+    }
+
+    for (int i = 0; i < total_size; ++i) {
+        koopa_raw_value_data * elem = make_alloc_int("@" + name + "_" + std::to_string(i));
+        blocks_list.addInst(elem);
+        arr->elems.push_back(elem);
+    }
+    symbol_list.addSymbol(name, LValSymbol(LValSymbol::SymbolType::ScalarArray, arr));
+
+    if (init_val) {
+        init_val->preprocess(arr->sz);
+        for (int i = 0; i < total_size; ++i)
+            blocks_list.addInst(make_store(init_val->at(i), arr->elems[i]));
+    }
+}
+
+struct ModRef {
+    std::set<std::string> mod;
+    std::set<std::string> ref;
+};
+
+static std::map<std::string, ModRef> mod_ref;
+
+static void collect_mod_ref(const BaseAST * ast, ModRef & mr, std::set<std::string> & callees) {
+    if (auto assign = dynamic_cast<const AssignStmtAST *>(ast)) {
+        if (auto lval = dynamic_cast<const LValAST *>(assign->lval.get()))
+            mr.mod.insert(lval->name);
+    } else if (auto lval = dynamic_cast<const LValAST *>(ast))
+        mr.ref.insert(lval->name);
+    else if (auto unary = dynamic_cast<const UnaryExpAST *>(ast); unary && unary->type == UnaryExpAST::UnaryExpType::Function)
+        callees.insert(unary->op);
+
+    ast->for_each_child([&](const BaseAST * child) { collect_mod_ref(child, mr, callees); });
+}
+
+// 只按名字统计, 局部变量与全局变量同名时会多算, 结果偏保守
+void compute_mod_ref(const std::vector<std::unique_ptr<BaseAST>> & funcs) {
+    std::map<std::string, std::set<std::string>> calls;
+
+    mod_ref.clear();
+    for (const auto & it : funcs) {
+        auto func = (const FuncDefAST *) it.get();
+        collect_mod_ref(func, mod_ref[func->ident], calls[func->ident]);
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto & [name, mr] : mod_ref)
+            for (const auto & callee : calls[name]) {
+                if (! mod_ref.count(callee) || callee == name)
+                    continue;
+                size_t size = mr.mod.size() + mr.ref.size();
+                mr.mod.insert(mod_ref[callee].mod.begin(), mod_ref[callee].mod.end());
+                mr.ref.insert(mod_ref[callee].ref.begin(), mod_ref[callee].ref.end());
+                changed = changed || mr.mod.size() + mr.ref.size() != size;
+            }
+    }
+}
+
+void write_back_promoted(const std::string & callee) {
+    for (const auto & g : BaseAST::loop_list.get_promoted())
+        if (g.written && (callee.empty() || (mod_ref.count(callee) && mod_ref[callee].ref.count(g.name)))) {
+            koopa_raw_value_data * load = make_load(g.local);
+            BaseAST::blocks_list.addInst(load);
+            BaseAST::blocks_list.addInst(make_store(load, g.global));
+        }
+}
+
+static void collect_callees(const BaseAST * ast, std::set<std::string> & callees) {
+    if (auto unary = dynamic_cast<const UnaryExpAST *>(ast); unary && unary->type == UnaryExpAST::UnaryExpType::Function)
+        callees.insert(unary->op);
+    ast->for_each_child([&](const BaseAST * child) { collect_callees(child, callees); });
+}
+
+// 循环中用到, 且循环内的调用都不会修改的全局标量, 在进入循环前读到局部变量里,
+// 循环中只访问局部变量, 在循环结束, 函数返回以及调用会读取它的函数之前写回
+bool WhileStmtAST::promote_globals() const {
+    std::set<std::string> names, decls, callees;
+    collect_names(this, names);
+    collect_callees(this, callees);
+    if (stmt)
+        collect_decls(stmt.get(), decls);
+
+    LoopSummary sum;
+    summarize_loop(this, sum);
+
+    std::vector<PromotedGlobal> promoted;
+    for (const auto & name : names) {
+        auto var = symbol_list.getSymbol(name);
+        if (decls.count(name) || var.type != LValSymbol::SymbolType::Var || ((koopa_raw_value_t) var.number)->kind.tag != KOOPA_RVT_GLOBAL_ALLOC)
+            continue;
+
+        bool modified = false;
+        for (const auto & callee : callees)
+            if (mod_ref.count(callee) && mod_ref[callee].mod.count(name))
+                modified = true;
+        if (! modified)
+            promoted.push_back({ name, (koopa_raw_value_t) var.number, nullptr, sum.written.count(name) > 0 });
+    }
+    if (promoted.empty())
+        return false;
+
+    symbol_list.newEnv();
+    for (auto & g : promoted) {
+        koopa_raw_value_data * local = make_alloc_int("%" + g.name + "_" + std::to_string(while_id));
+        koopa_raw_value_data * load  = make_load(g.global);
+        blocks_list.addInst(local);
+        blocks_list.addInst(load);
+        blocks_list.addInst(make_store(load, local));
+
+        g.local = local;
+        symbol_list.addSymbol(g.name, LValSymbol(LValSymbol::SymbolType::Var, local));
+        loop_list.push_promoted(g);
+    }
+
+    to_koopa_item();
+
+    for (auto & g : promoted) {
+        loop_list.pop_promoted();
+        if (g.written) {
+            koopa_raw_value_data * load = make_load(g.local);
+            blocks_list.addInst(load);
+            blocks_list.addInst(make_store(load, g.global));
+        }
+    }
+    symbol_list.deleteEnv();
+    return true;
+}
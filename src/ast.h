@@ -1,12 +1,16 @@
 #pragma once
 
 #include <assert.h>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
 #include <vector>
 
 #include "block.h"
 #include "koopa_util.h"
+#include "options.h"
 #include "symbol_list.h"
 #include "while_container.h"
 
@@ -17,10 +21,19 @@ public:
     static BlockMaker     blocks_list;
     static LoopMaintainer loop_list;
 
+    static std::map<std::string, koopa_raw_function_t> runtime_decls;
+
+    static koopa_raw_function_t runtime_routine(const std::string & name, const std::vector<const void *> & fparams, koopa_raw_type_tag_t ret = KOOPA_RTT_UNIT);
+
+    // 并行化时从循环中提取出的函数, 附在程序末尾
+    static std::vector<const void *> outlined_funcs;
+
     virtual ~BaseAST() = default;
 
     virtual void Dump() const {}
 
+    virtual void for_each_child(const std::function<void(const BaseAST *)> & f) const {}
+
     virtual void * to_koopa_item() const {
         std::cout << "Run into ERROR\n";
         return nullptr;
@@ -33,6 +46,11 @@ public:
         std::cout << "Run into ERROR\n";
         return 0;
     }
+
+    // 作为 if / while 的条件时直接跳转到 true_bb / false_bb, 不必先算出 0/1
+    virtual void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const {
+        blocks_list.addInst(make_branch((koopa_raw_value_t) to_koopa_item(), true_bb, false_bb));
+    }
 };
 
 class LValueBaseAST : public ValueBaseAST {
@@ -43,6 +61,27 @@ public:
     }
 };
 
+// 表达式被无条件 (推测) 执行时的代价; 含调用, 除法或可能越界的访存时返回 -1
+// safe_loads 中的数组元素已在别处无条件访问过, 可以安全地提前读取
+int speculation_cost(const BaseAST * exp, const std::vector<const BaseAST *> & safe_loads = {});
+
+bool can_speculate(const BaseAST * exp);
+
+bool same_ast(const BaseAST * a, const BaseAST * b);
+
+// 计算每个函数 (连同其调用的函数) 可能读写的变量名
+void compute_mod_ref(const std::vector<std::unique_ptr<BaseAST>> & funcs);
+
+// 把循环中提升到局部变量且被修改过的全局变量写回内存;
+// callee 非空时只写回 callee 可能读取的那些
+void write_back_promoted(const std::string & callee = "");
+
+// 拆成标量的局部数组, 每个元素一个 alloc
+struct ScalarArray {
+    std::vector<int>               sz;
+    std::vector<koopa_raw_value_t> elems;
+};
+
 // CompUnit 是 BaseAST
 class CompUnitAST : public BaseAST {
     void add_lib(std::vector<const void *> & funcs) const;
@@ -66,6 +105,15 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        for (const auto & it : const_value_list)
+            f(it.get());
+        for (const auto & it : var_value_list)
+            f(it.get());
+        for (const auto & it : func_list)
+            f(it.get());
+    }
+
     void * to_koopa_item() const override {
         return nullptr;
     }
@@ -76,6 +124,7 @@ public:
         std::vector<const void *> funcs;
 
         add_lib(funcs);
+        compute_mod_ref(func_list);
 
         for (const auto & it : const_value_list)
             it->to_koopa_item();
@@ -85,6 +134,10 @@ public:
 
         for (const auto & it : func_list)
             funcs.push_back(it->to_koopa_item());
+        funcs.insert(funcs.end(), outlined_funcs.begin(), outlined_funcs.end());
+
+        for (const auto & it : runtime_decls)
+            funcs.push_back(it.second);
 
         symbol_list.deleteEnv();
 
@@ -177,18 +230,24 @@ public:
         std::cout << " }";
     }
 
+    // 依次生成各条语句; 满足条件的小数组拆成标量, 见 ArrayDefAST::can_scalarize
+    void emit_insts() const;
+
     void * to_koopa_item_no_env() const {
-        for (const auto & it : insts)
-            it->to_koopa_item();
+        emit_insts();
 
         return nullptr;
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        for (const auto & it : insts)
+            f(it.get());
+    }
+
     void * to_koopa_item() const override {
         symbol_list.newEnv();
 
-        for (const auto & it : insts)
-            it->to_koopa_item();
+        emit_insts();
 
         symbol_list.deleteEnv();
 
@@ -210,6 +269,11 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        f(lval.get());
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         koopa_raw_value_data * res = new koopa_raw_value_data();
 
@@ -238,6 +302,11 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (exp)
+            f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         koopa_raw_value_data * res = new koopa_raw_value_data();
 
@@ -251,6 +320,7 @@ public:
         else
             res->kind.data.ret.value = nullptr;
 
+        write_back_promoted();
         blocks_list.addInst(res);
         return res;
     }
@@ -274,6 +344,10 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        f(block.get());
+    }
+
     void * to_koopa_item() const override {
         koopa_raw_function_data_t * res = new koopa_raw_function_data_t();
 
@@ -351,12 +425,14 @@ public:
 
 // Stmt
 class BranchStmtAST : public BaseAST {
+    bool if_convert() const;
+
 public:
     int branch_id;
 
     std::unique_ptr<BaseAST> lval;
 
-    std::unique_ptr<BaseAST> exp;
+    std::unique_ptr<ValueBaseAST> exp;
 
     std::unique_ptr<BaseAST> rval;
 
@@ -374,25 +450,32 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        f(exp.get());
+        if (lval)
+            f(lval.get());
+        if (rval)
+            f(rval.get());
+    }
+
     void * to_koopa_item() const override {
-        koopa_raw_value_data * res = new koopa_raw_value_data();
+        bool taken;
+        if (loop_list.get_unswitch(this, taken)) {
+            if (taken && lval)
+                lval->to_koopa_item();
+            else if (! taken && rval)
+                rval->to_koopa_item();
+            return nullptr;
+        }
 
-        res->ty                    = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
-        res->name                  = nullptr;
-        res->used_by               = empty_koopa_rs(KOOPA_RSIK_VALUE);
-        res->kind.tag              = KOOPA_RVT_BRANCH;
-        res->kind.data.branch.cond = (koopa_raw_value_t) exp->to_koopa_item();
+        if (options.if_conversion && if_convert())
+            return nullptr;
 
         koopa_raw_basic_block_data_t * true_block  = new koopa_raw_basic_block_data_t();
         koopa_raw_basic_block_data_t * false_block = new koopa_raw_basic_block_data_t();
         koopa_raw_basic_block_data_t * end_block   = new koopa_raw_basic_block_data_t();
 
-        res->kind.data.branch.true_bb    = true_block;
-        res->kind.data.branch.false_bb   = false_block;
-        res->kind.data.branch.true_args  = empty_koopa_rs(KOOPA_RSIK_VALUE);
-        res->kind.data.branch.false_args = empty_koopa_rs(KOOPA_RSIK_VALUE);
-
-        blocks_list.addInst(res);
+        exp->to_koopa_cond(true_block, false_block);
 
         true_block->name    = make_char_arr("%true_" + std::to_string(branch_id));
         true_block->params  = empty_koopa_rs(KOOPA_RSIK_VALUE);
@@ -422,8 +505,16 @@ public:
 };
 
 class WhileStmtAST : public BaseAST {
+    const BranchStmtAST * find_unswitch_branch() const;
+
+    bool lower_mem_idiom() const;
+
+    bool promote_globals() const;
+
+    bool parallelize() const;
+
 public:
-    std::unique_ptr<BaseAST> exp;
+    std::unique_ptr<ValueBaseAST> exp;
 
     std::unique_ptr<BaseAST> stmt;
 
@@ -439,7 +530,57 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        f(exp.get());
+        if (stmt)
+            f(stmt.get());
+    }
+
     virtual void * to_koopa_item() const override {
+        if (options.promote_globals && promote_globals())
+            return nullptr;
+
+        if (options.loop_idiom && options.runtime_routines && lower_mem_idiom())
+            return nullptr;
+
+        if (options.parallel_threads > 1 && parallelize())
+            return nullptr;
+
+        const BranchStmtAST * inv = find_unswitch_branch();
+        if (! inv)
+            return emit_loop();
+
+        koopa_raw_basic_block_data_t * true_block  = new koopa_raw_basic_block_data_t();
+        koopa_raw_basic_block_data_t * false_block = new koopa_raw_basic_block_data_t();
+        koopa_raw_basic_block_data_t * end_block   = new koopa_raw_basic_block_data_t();
+
+        inv->exp->to_koopa_cond(true_block, false_block);
+
+        true_block->name    = make_char_arr("%unswitch_true_" + std::to_string(while_id));
+        true_block->params  = empty_koopa_rs(KOOPA_RSIK_VALUE);
+        true_block->used_by = empty_koopa_rs(KOOPA_RSIK_VALUE);
+        blocks_list.addBlock(true_block);
+        loop_list.set_unswitch(inv, true);
+        to_koopa_item();
+        blocks_list.addInst(make_jump_block(end_block));
+
+        false_block->name    = make_char_arr("%unswitch_false_" + std::to_string(while_id));
+        false_block->params  = empty_koopa_rs(KOOPA_RSIK_VALUE);
+        false_block->used_by = empty_koopa_rs(KOOPA_RSIK_VALUE);
+        blocks_list.addBlock(false_block);
+        loop_list.set_unswitch(inv, false);
+        to_koopa_item();
+        blocks_list.addInst(make_jump_block(end_block));
+        loop_list.clear_unswitch(inv);
+
+        end_block->name    = make_char_arr("%unswitch_end_" + std::to_string(while_id));
+        end_block->params  = empty_koopa_rs(KOOPA_RSIK_VALUE);
+        end_block->used_by = empty_koopa_rs(KOOPA_RSIK_VALUE);
+        blocks_list.addBlock(end_block);
+        return nullptr;
+    }
+
+    void * emit_loop() const {
         koopa_raw_basic_block_data_t * while_entry = new koopa_raw_basic_block_data_t();
         koopa_raw_basic_block_data_t * while_body  = new koopa_raw_basic_block_data_t();
         koopa_raw_basic_block_data_t * end_block   = new koopa_raw_basic_block_data_t();
@@ -453,17 +594,7 @@ public:
         while_entry->used_by = empty_koopa_rs(KOOPA_RSIK_VALUE);
         blocks_list.addBlock(while_entry);
 
-        koopa_raw_value_data * br       = new koopa_raw_value_data();
-        br->ty                          = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
-        br->name                        = nullptr;
-        br->used_by                     = empty_koopa_rs(KOOPA_RSIK_VALUE);
-        br->kind.tag                    = KOOPA_RVT_BRANCH;
-        br->kind.data.branch.cond       = (koopa_raw_value_t) exp->to_koopa_item();
-        br->kind.data.branch.true_bb    = while_body;
-        br->kind.data.branch.false_bb   = end_block;
-        br->kind.data.branch.true_args  = empty_koopa_rs(KOOPA_RSIK_VALUE);
-        br->kind.data.branch.false_args = empty_koopa_rs(KOOPA_RSIK_VALUE);
-        blocks_list.addInst(br);
+        exp->to_koopa_cond(while_body, end_block);
 
         while_body->name    = make_char_arr("%while_body_" + std::to_string(while_id));
         while_body->params  = empty_koopa_rs(KOOPA_RSIK_VALUE);
@@ -509,16 +640,31 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         return exp->to_koopa_item();
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        exp->to_koopa_cond(true_bb, false_bb);
+    }
+
     int get_value() const override {
         return exp->get_value();
     }
 };
 
 class LValAST : public LValueBaseAST {
+    koopa_raw_value_t scalar_element(const ScalarArray * arr) const {
+        int flat = 0;
+        for (size_t i = 0; i < idx.size(); ++i)
+            flat = flat * arr->sz[i] + ((const ValueBaseAST *) idx[i].get())->get_value();
+        return arr->elems[flat];
+    }
+
 public:
     enum class ValType {
         Num,
@@ -534,6 +680,11 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        for (const auto & it : idx)
+            f(it.get());
+    }
+
     void * to_koopa_item() const override {
         koopa_raw_value_data * res = new koopa_raw_value_data();
 
@@ -541,7 +692,11 @@ public:
 
         if (var.type == LValSymbol::SymbolType::Const)
             return (void *) var.number;
-        else if (var.type == LValSymbol::SymbolType::Var) {
+        else if (var.type == LValSymbol::SymbolType::ScalarArray) {
+            koopa_raw_value_data * load = make_load(scalar_element((const ScalarArray *) var.number));
+            blocks_list.addInst(load);
+            return load;
+        } else if (var.type == LValSymbol::SymbolType::Var) {
             res->ty                 = simple_koopa_raw_type_kind(KOOPA_RTT_INT32);
             res->name               = nullptr;
             res->used_by            = empty_koopa_rs(KOOPA_RSIK_VALUE);
@@ -635,6 +790,8 @@ public:
     void * build_left_value() const override {
         if (type == ValType::Num)
             return (void *) symbol_list.getSymbol(name).number;
+        else if (symbol_list.getSymbol(name).type == LValSymbol::SymbolType::ScalarArray)
+            return (void *) scalar_element((const ScalarArray *) symbol_list.getSymbol(name).number);
         else {
             koopa_raw_value_t src = (koopa_raw_value_t) symbol_list.getSymbol(name).number;
 
@@ -693,6 +850,11 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type != PrimaryExpType::Number)
+            f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type != PrimaryExpType::Number)
             return exp->to_koopa_item();
@@ -700,6 +862,13 @@ public:
             return (void *) make_number_koopa(number);
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type != PrimaryExpType::Number)
+            exp->to_koopa_cond(true_bb, false_bb);
+        else
+            blocks_list.addInst(make_jump_block(number ? true_bb : false_bb));
+    }
+
     int get_value() const override {
         if (type == PrimaryExpType::Number)
             return number;
@@ -735,6 +904,14 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == UnaryExpType::Function)
+            for (const auto & it : func_r_params)
+                f(it.get());
+        else
+            f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type == UnaryExpType::PrimaryExp || (type == UnaryExpType::UnaryExp && op == "+"))
             return exp->to_koopa_item();
@@ -754,6 +931,7 @@ public:
             res->kind.tag              = KOOPA_RVT_CALL;
             res->kind.data.call.callee = func;
             res->kind.data.call.args   = make_koopa_rs_from_vector(rpa, KOOPA_RSIK_VALUE);
+            write_back_promoted(op);
             blocks_list.addInst(res);
             return res;
         } else {
@@ -777,6 +955,16 @@ public:
         }
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        // -x 与 x 同为零或同为非零
+        if (type == UnaryExpType::PrimaryExp || (type == UnaryExpType::UnaryExp && op != "!"))
+            exp->to_koopa_cond(true_bb, false_bb);
+        else if (type == UnaryExpType::UnaryExp)
+            exp->to_koopa_cond(false_bb, true_bb);
+        else
+            ValueBaseAST::to_koopa_cond(true_bb, false_bb);
+    }
+
     int get_value() const override {
         if (type == UnaryExpType::PrimaryExp || (type == UnaryExpType::UnaryExp && op == "+"))
             return exp->get_value();
@@ -808,6 +996,12 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == MulExpType::Binary)
+            f(left_exp.get());
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type == MulExpType::Unary)
             return exp->to_koopa_item();
@@ -834,6 +1028,13 @@ public:
         }
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == MulExpType::Unary)
+            exp->to_koopa_cond(true_bb, false_bb);
+        else
+            ValueBaseAST::to_koopa_cond(true_bb, false_bb);
+    }
+
     int get_value() const override {
         if (type == MulExpType::Unary)
             return exp->get_value();
@@ -867,6 +1068,12 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == AddExpType::Binary)
+            f(left_exp.get());
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type == AddExpType::Unary)
             return exp->to_koopa_item();
@@ -891,6 +1098,13 @@ public:
         }
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == AddExpType::Unary)
+            exp->to_koopa_cond(true_bb, false_bb);
+        else
+            ValueBaseAST::to_koopa_cond(true_bb, false_bb);
+    }
+
     int get_value() const override {
         if (type == AddExpType::Unary)
             return exp->get_value();
@@ -922,6 +1136,12 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == RelExpType::Binary)
+            f(left_exp.get());
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type == RelExpType::Unary)
             return exp->to_koopa_item();
@@ -950,6 +1170,13 @@ public:
         }
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == RelExpType::Unary)
+            exp->to_koopa_cond(true_bb, false_bb);
+        else
+            ValueBaseAST::to_koopa_cond(true_bb, false_bb);
+    }
+
     int get_value() const override {
         if (type == RelExpType::Unary)
             return exp->get_value();
@@ -985,6 +1212,12 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == EqExpType::Binary)
+            f(left_exp.get());
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type == EqExpType::Unary)
             return exp->to_koopa_item();
@@ -1009,6 +1242,13 @@ public:
         }
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == EqExpType::Unary)
+            exp->to_koopa_cond(true_bb, false_bb);
+        else
+            ValueBaseAST::to_koopa_cond(true_bb, false_bb);
+    }
+
     int get_value() const override {
         if (type == EqExpType::Unary)
             return exp->get_value();
@@ -1056,10 +1296,23 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == LAndExpType::Binary)
+            f(left_exp.get());
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type == LAndExpType::Unary)
             return exp->to_koopa_item();
-        else {
+        else if (options.if_conversion && can_speculate(exp.get())) {
+            koopa_raw_value_t lhs = to_bool_koopa((koopa_raw_value_t) left_exp->to_koopa_item());
+            koopa_raw_value_t rhs = to_bool_koopa((koopa_raw_value_t) exp->to_koopa_item());
+
+            koopa_raw_value_data * res = make_binary(KOOPA_RBO_AND, lhs, rhs);
+            blocks_list.addInst(res);
+            return res;
+        } else {
             koopa_raw_value_data * t = new koopa_raw_value_data();
 
             t->ty       = make_int_pointer_type();
@@ -1128,6 +1381,18 @@ public:
         }
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == LAndExpType::Unary)
+            exp->to_koopa_cond(true_bb, false_bb);
+        else {
+            koopa_raw_basic_block_data_t * rhs_block = make_block("%and_rhs_" + std::to_string(branch_id));
+
+            left_exp->to_koopa_cond(rhs_block, false_bb);
+            blocks_list.addBlock(rhs_block);
+            exp->to_koopa_cond(true_bb, false_bb);
+        }
+    }
+
     int get_value() const override {
         if (type == LAndExpType::Unary)
             return exp->get_value();
@@ -1176,10 +1441,23 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == LOrExpType::Binary)
+            f(left_exp.get());
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         if (type == LOrExpType::Unary)
             return exp->to_koopa_item();
-        else {
+        else if (options.if_conversion && can_speculate(exp.get())) {
+            koopa_raw_value_t lhs = to_bool_koopa((koopa_raw_value_t) left_exp->to_koopa_item(), false);
+            koopa_raw_value_t rhs = to_bool_koopa((koopa_raw_value_t) exp->to_koopa_item(), false);
+
+            koopa_raw_value_data * res = make_binary(KOOPA_RBO_OR, lhs, rhs);
+            blocks_list.addInst(res);
+            return res;
+        } else {
             koopa_raw_value_data * t = new koopa_raw_value_data();
 
             t->ty       = make_int_pointer_type();
@@ -1248,6 +1526,18 @@ public:
         }
     }
 
+    void to_koopa_cond(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) const override {
+        if (type == LOrExpType::Unary)
+            exp->to_koopa_cond(true_bb, false_bb);
+        else {
+            koopa_raw_basic_block_data_t * rhs_block = make_block("%or_rhs_" + std::to_string(branch_id));
+
+            left_exp->to_koopa_cond(true_bb, rhs_block);
+            blocks_list.addBlock(rhs_block);
+            exp->to_koopa_cond(true_bb, false_bb);
+        }
+    }
+
     int get_value() const override {
         if (type == LOrExpType::Unary)
             return exp->get_value();
@@ -1268,6 +1558,10 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         koopa_raw_value_data * res = new koopa_raw_value_data();
 
@@ -1296,6 +1590,11 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (exp)
+            f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         koopa_raw_value_data * res = new koopa_raw_value_data();
 
@@ -1339,6 +1638,11 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (exp)
+            f(exp.get());
+    }
+
     void * to_koopa_item() const override {
         koopa_raw_value_data * res = new koopa_raw_value_data();
 
@@ -1387,6 +1691,14 @@ public:
         std::cout << " }";
     }
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        if (type == InitValType::Exp)
+            f(exp.get());
+        else
+            for (const auto & it : arr_list)
+                f(it.get());
+    }
+
     void sub_preprocess(std::vector<int> & pro, int align_pos, std::vector<koopa_raw_value_t> & buf) {
         int target_size = buf.size() + pro[align_pos];
 
@@ -1470,12 +1782,29 @@ class ArrayDefAST : public BaseAST {
         return get_index(i % pro[cur_pos], pro, get, cur_pos + 1);
     }
 
+    // 零元素多于此数时先用循环整体清零, 只单独存储非零元素
+    static const int zero_fill_threshold = 8;
+
+    void zero_fill(koopa_raw_value_t base, int n) const;
+
 public:
     std::string                 name;
     std::unique_ptr<InitValAST> init_val;
 
     std::vector<std::unique_ptr<ValueBaseAST>> sz_exp;
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        for (const auto & it : sz_exp)
+            f(it.get());
+        if (init_val)
+            f(init_val.get());
+    }
+
+    // 数组足够小, 且在 scope[from..] 中只以常量下标访问单个元素时, 可以拆成标量
+    bool can_scalarize(const std::vector<std::unique_ptr<BaseAST>> & scope, size_t from) const;
+
+    void scalarize() const;
+
     void * to_koopa_item() const override {
         int total_size = 1;
 
@@ -1508,17 +1837,31 @@ public:
             for (int i = sz.size() - 2; i >= 0; --i)
                 pro[i] = pro[i + 1] * sz[i + 1];
 
+            std::vector<koopa_raw_value_t> vals;
+            int                            zeros = 0;
             for (int i = 0; i < total_size; ++i) {
-                koopa_raw_value_data * get = get_index(i, pro, res);
-
-                koopa_raw_value_data * st = new koopa_raw_value_data();
-                st->ty                    = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
-                st->name                  = nullptr;
-                st->used_by               = empty_koopa_rs(KOOPA_RSIK_VALUE);
-                st->kind.tag              = KOOPA_RVT_STORE;
-                st->kind.data.store.dest  = get;
-                st->kind.data.store.value = init_val->at(i);
-                blocks_list.addInst(st);
+                vals.push_back(init_val->at(i));
+                if (is_zero_koopa(vals.back()))
+                    ++zeros;
+            }
+
+            // 指向首元素的 *i32, 之后用 getptr 按展平后的下标访问
+            koopa_raw_value_data * base = get_index(0, pro, res);
+
+            bool fill = zeros > zero_fill_threshold;
+            if (fill)
+                zero_fill(base, total_size);
+
+            for (int i = 0; i < total_size; ++i) {
+                if (fill && is_zero_koopa(vals[i]))
+                    continue;
+
+                koopa_raw_value_data * get = base;
+                if (i) {
+                    get = set_ptr(base, make_number_koopa(i), false, KOOPA_RVT_GET_PTR);
+                    blocks_list.addInst(get);
+                }
+                blocks_list.addInst(make_store(vals[i], get));
             }
         }
         return res;
@@ -1532,6 +1875,13 @@ public:
 
     std::vector<std::unique_ptr<ValueBaseAST>> sz_exp;
 
+    void for_each_child(const std::function<void(const BaseAST *)> & f) const override {
+        for (const auto & it : sz_exp)
+            f(it.get());
+        if (init_val)
+            f(init_val.get());
+    }
+
     void * to_koopa_item() const override {
         std::vector<int> sz;
         for (const auto & e : sz_exp)
@@ -13,11 +13,14 @@ public:
     std::vector<const void *>   insts_buf;
     std::vector<const void *> * block_buf;
 
+    std::map<std::string, int> block_names;
+
     void setFunc(koopa_raw_function_t _func) {
         func = _func;
     }
     void setBlockBuf(std::vector<const void *> * _block_buf) {
         block_buf = _block_buf;
+        block_names.clear();
     }
     void finishBlock() {
         if (block_buf->size()) {
@@ -58,6 +61,13 @@ public:
     void addBlock(koopa_raw_basic_block_data_t * basic_block) {
         finishBlock();
         basic_block->insts.buffer = nullptr;
+
+        // 同一段 AST 可能被生成多次 (如循环判断外提), 需保证基本块名唯一
+        std::string name = basic_block->name;
+        int         cnt  = block_names[name]++;
+        if (cnt)
+            basic_block->name = make_char_arr(name + "_" + std::to_string(cnt));
+
         block_buf->push_back(basic_block);
     }
 
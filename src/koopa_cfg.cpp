@@ -0,0 +1,104 @@
+#include "koopa_cfg.h"
+
+FunctionCFG::FunctionCFG(const koopa_raw_function_t & func) {
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb   = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        index[bb] = blocks.size();
+        blocks.push_back(bb);
+    }
+
+    int n = blocks.size();
+    succ.resize(n);
+    pred.resize(n);
+    for (int i = 0; i < n; ++i) {
+        const auto & insts = blocks[i]->insts;
+        auto         last  = (koopa_raw_value_t) insts.buffer[insts.len - 1];
+        if (last->kind.tag == KOOPA_RVT_BRANCH) {
+            succ[i].push_back(index[last->kind.data.branch.true_bb]);
+            succ[i].push_back(index[last->kind.data.branch.false_bb]);
+        } else if (last->kind.tag == KOOPA_RVT_JUMP)
+            succ[i].push_back(index[last->kind.data.jump.target]);
+        for (int s : succ[i])
+            pred[s].push_back(i);
+    }
+
+    // 逆后序
+    std::vector<int>                 post;
+    std::vector<bool>                seen(n, false);
+    std::vector<std::pair<int, int>> stack = {{0, 0}};
+    seen[0]                                = true;
+    while (! stack.empty()) {
+        auto & [b, k] = stack.back();
+        if (k < (int) succ[b].size()) {
+            int s = succ[b][k++];
+            if (! seen[s]) {
+                seen[s] = true;
+                stack.push_back({s, 0});
+            }
+        } else {
+            post.push_back(b);
+            stack.pop_back();
+        }
+    }
+    rpo_num.assign(n, -1);
+    for (int i = 0; i < (int) post.size(); ++i)
+        rpo_num[post[i]] = post.size() - 1 - i;
+
+    // Cooper-Harvey-Kennedy 迭代求直接支配者
+    idom.assign(n, -1);
+    idom[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto it = post.rbegin(); it != post.rend(); ++it) {
+            int b = *it, d = -1;
+            if (b == 0)
+                continue;
+            for (int p : pred[b])
+                if (idom[p] != -1)
+                    d = d == -1 ? p : common_dominator(p, d);
+            if (idom[b] != d) {
+                idom[b] = d;
+                changed = true;
+            }
+        }
+    }
+
+    // 回边 b -> h 的自然循环
+    in_loop.assign(n, false);
+    for (int b = 0; b < n; ++b)
+        for (int h : succ[b])
+            if (reachable(b) && dominates(h, b)) {
+                in_loop[h] = true;
+                std::vector<bool> body(n, false);
+                std::vector<int>  work = {b};
+                body[h]                = true;
+                while (! work.empty()) {
+                    int x = work.back();
+                    work.pop_back();
+                    if (body[x])
+                        continue;
+                    body[x] = in_loop[x] = true;
+                    for (int p : pred[x])
+                        if (reachable(p))
+                            work.push_back(p);
+                }
+            }
+}
+
+bool FunctionCFG::dominates(int a, int b) const {
+    if (! reachable(a) || ! reachable(b))
+        return false;
+    while (b != a && b != 0)
+        b = idom[b];
+    return b == a;
+}
+
+int FunctionCFG::common_dominator(int a, int b) const {
+    while (a != b) {
+        while (rpo_num[a] > rpo_num[b])
+            a = idom[a];
+        while (rpo_num[b] > rpo_num[a])
+            b = idom[b];
+    }
+    return a;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "koopa.h"
+#include <map>
+#include <vector>
+
+// 函数的控制流图. 基本块按在函数中出现的顺序编号, 0 号是入口
+struct FunctionCFG {
+    std::vector<koopa_raw_basic_block_t>   blocks;
+    std::map<koopa_raw_basic_block_t, int> index;
+    std::vector<std::vector<int>>          succ, pred;
+
+    // 直接支配者, 入口为 0, 不可达的块为 -1
+    std::vector<int>  idom;
+    std::vector<int>  rpo_num;
+    std::vector<bool> in_loop;
+
+    explicit FunctionCFG(const koopa_raw_function_t & func);
+
+    bool reachable(int b) const { return idom[b] != -1; }
+    bool dominates(int a, int b) const;
+    int  common_dominator(int a, int b) const;
+};
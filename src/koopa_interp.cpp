@@ -0,0 +1,535 @@
+#include "koopa_interp.h"
+#include "koopa_riscv.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// 字节码. 操作数都是当前栈帧中寄存器槽的编号, 常量和全局变量的地址在函数入口处填进常量槽
+enum class IOp : uint8_t {
+    // a = b op c, 与 koopa_raw_binary_op 的顺序一致
+    NE, EQ, GT, LT, GE, LE, ADD, SUB, MUL, DIV, MOD, AND, OR, XOR, SHL, SHR, SAR,
+    ALLOC,   // a = 栈帧中偏移 b 处的地址
+    LOAD,    // a = mem[b]
+    STORE,   // mem[b] = a
+    GET_PTR, // a = b + c * d
+    BR,      // a ? 块 b : 块 c
+    JUMP,    // 块 a
+    CALL,    // a = 函数 b (arg_pool[c .. c + d)), 没有返回值时 a 为 -1
+    NATIVE,  // 同上, b 是库函数的编号
+    RET,     // 返回 a, 没有返回值时 a 为 -1
+};
+
+struct Code {
+    IOp     op;
+    int32_t a = 0, b = 0, c = 0, d = 0;
+};
+
+struct Function {
+    std::string          name;
+    int                  entry;       // 入口块的编号
+    int                  nslots;      // 参数占 0 .. 参数个数, 常量占 const_base 开始的槽
+    int                  const_base;
+    std::vector<int32_t> consts;
+    uint32_t             frame_words; // alloc 占用的内存
+    uint64_t             calls = 0;
+};
+
+struct Block {
+    int         func;
+    uint32_t    pc;   // 第一条字节码的位置
+    uint32_t    size; // IR 指令数
+    std::string name;
+    uint64_t    count = 0;
+};
+
+// 按编号的顺序
+enum Native {
+    GETINT, GETCH, GETARRAY, PUTINT, PUTCH, PUTARRAY, STARTTIME, STOPTIME,
+    MEMSET, MEMCPY, VADD_VV, VSUB_VV, VMUL_VV, VADD_VX, VRSUB_VX, VMUL_VX, VSUM,
+    NATIVE_COUNT
+};
+
+const char * native_names[] = {
+    "@getint", "@getch", "@getarray", "@putint", "@putch", "@putarray", "@starttime", "@stoptime",
+    "@__sysy_memset", "@__sysy_memcpy", "@__sysy_vadd_vv", "@__sysy_vsub_vv", "@__sysy_vmul_vv",
+    "@__sysy_vadd_vx", "@__sysy_vrsub_vx", "@__sysy_vmul_vx", "@__sysy_vsum",
+};
+
+static_assert(sizeof(native_names) / sizeof(native_names[0]) == NATIVE_COUNT);
+
+// 调用者的现场
+struct Frame {
+    int      func;
+    uint32_t pc, base, fp;
+    int32_t  dst;
+};
+
+// 内存按字编址, 0 号字不用, 作为空指针; 全局变量之后是栈, 每次调用在栈顶分配 alloc 需要的空间
+const uint32_t max_memory_words = 1u << 28;
+
+class Interpreter {
+public:
+    explicit Interpreter(const koopa_raw_program_t & raw);
+
+    int  run();
+    void report(std::ostream & os) const;
+
+private:
+    std::vector<Code>     code;
+    std::vector<int32_t>  arg_pool;
+    std::vector<Function> funcs;
+    std::vector<Block>    blocks;
+    int                   main_func = -1;
+    uint64_t              native_calls[NATIVE_COUNT] = {};
+
+    // starttime/stoptime 之间执行的指令数
+    uint64_t timer_insts = 0, timed_insts = 0;
+    int      timers      = 0;
+
+    std::unordered_map<koopa_raw_function_t, int>    func_id;
+    std::unordered_map<koopa_raw_basic_block_t, int> block_id;
+    std::unordered_map<koopa_raw_value_t, uint32_t>  global_addr;
+
+    std::vector<int32_t> mem{0};
+    std::vector<int32_t> regs;
+
+    static uint32_t words(koopa_raw_type_t ty) { return cal_size(ty) / 4; }
+
+    uint64_t executed() const;
+
+    void init_global(koopa_raw_value_t init, uint32_t addr);
+    void translate(koopa_raw_function_t func, Function & f);
+    bool fault(const std::string & msg) const;
+    bool valid(uint32_t addr, uint32_t n) const { return addr && addr <= mem.size() && n <= mem.size() - addr; }
+    bool call_native(int k, const int32_t * args, int32_t & res);
+};
+
+}
+
+Interpreter::Interpreter(const koopa_raw_program_t & raw) {
+    for (size_t i = 0; i < raw.values.len; ++i) {
+        auto value          = (koopa_raw_value_t) raw.values.buffer[i];
+        uint32_t addr       = mem.size();
+        global_addr[value]  = addr;
+        mem.resize(addr + words(value->ty->data.pointer.base));
+        init_global(value->kind.data.global_alloc.init, addr);
+    }
+
+    // 先给所有函数和基本块编号, 翻译时可以引用后面的函数和块
+    for (size_t i = 0; i < raw.funcs.len; ++i) {
+        auto func = (koopa_raw_function_t) raw.funcs.buffer[i];
+        if (! func->bbs.len)
+            continue;
+        func_id[func] = funcs.size();
+        funcs.push_back({func->name});
+        if (std::string(func->name) == "@main")
+            main_func = func_id[func];
+        for (size_t j = 0; j < func->bbs.len; ++j) {
+            auto bb      = (koopa_raw_basic_block_t) func->bbs.buffer[j];
+            block_id[bb] = blocks.size();
+            blocks.push_back({func_id[func], 0, (uint32_t) bb->insts.len, bb->name ? bb->name : "%?"});
+        }
+    }
+    for (size_t i = 0; i < raw.funcs.len; ++i) {
+        auto func = (koopa_raw_function_t) raw.funcs.buffer[i];
+        if (func->bbs.len)
+            translate(func, funcs[func_id[func]]);
+    }
+}
+
+void Interpreter::init_global(koopa_raw_value_t init, uint32_t addr) {
+    if (init->kind.tag == KOOPA_RVT_INTEGER)
+        mem[addr] = init->kind.data.integer.value;
+    else if (init->kind.tag == KOOPA_RVT_AGGREGATE) {
+        const auto & elems = init->kind.data.aggregate.elems;
+        for (size_t i = 0; i < elems.len; ++i) {
+            auto elem = (koopa_raw_value_t) elems.buffer[i];
+            init_global(elem, addr + i * words(elem->ty));
+        }
+    }
+}
+
+void Interpreter::translate(koopa_raw_function_t func, Function & f) {
+    // 有值的指令依次占用参数之后的槽, 常量在翻译中遇到时再分配
+    std::unordered_map<koopa_raw_value_t, int> slot;
+    int                                        n = func->params.len;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            if (inst->ty->tag != KOOPA_RTT_UNIT)
+                slot[inst] = n++;
+        }
+    }
+    f.const_base = n;
+    f.entry      = block_id[(koopa_raw_basic_block_t) func->bbs.buffer[0]];
+
+    std::map<int32_t, int> const_slot;
+    auto                   constant = [&](int32_t value) {
+        auto it = const_slot.find(value);
+        if (it != const_slot.end())
+            return it->second;
+        f.consts.push_back(value);
+        return const_slot[value] = n++;
+    };
+    auto operand = [&](koopa_raw_value_t value) -> int {
+        switch (value->kind.tag) {
+        case KOOPA_RVT_INTEGER:
+            return constant(value->kind.data.integer.value);
+        case KOOPA_RVT_ZERO_INIT:
+        case KOOPA_RVT_UNDEF:
+            return constant(0);
+        case KOOPA_RVT_GLOBAL_ALLOC:
+            return constant(global_addr.at(value));
+        case KOOPA_RVT_FUNC_ARG_REF:
+            return value->kind.data.func_arg_ref.index;
+        default:
+            assert(slot.count(value));
+            return slot[value];
+        }
+    };
+
+    f.frame_words = 0;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb                     = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        blocks[block_id[bb]].pc     = code.size();
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto         inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            const auto & kind = inst->kind;
+            int          dst  = inst->ty->tag != KOOPA_RTT_UNIT ? slot[inst] : -1;
+            switch (kind.tag) {
+            case KOOPA_RVT_ALLOC:
+                code.push_back({IOp::ALLOC, dst, (int32_t) f.frame_words});
+                f.frame_words += words(inst->ty->data.pointer.base);
+                break;
+            case KOOPA_RVT_LOAD:
+                code.push_back({IOp::LOAD, dst, operand(kind.data.load.src)});
+                break;
+            case KOOPA_RVT_STORE:
+                code.push_back({IOp::STORE, operand(kind.data.store.value), operand(kind.data.store.dest)});
+                break;
+            case KOOPA_RVT_GET_PTR: {
+                auto src = kind.data.get_ptr.src;
+                code.push_back({IOp::GET_PTR, dst, operand(src), operand(kind.data.get_ptr.index), (int32_t) words(src->ty->data.pointer.base)});
+                break;
+            }
+            case KOOPA_RVT_GET_ELEM_PTR: {
+                auto src = kind.data.get_elem_ptr.src;
+                auto arr = src->ty->data.pointer.base;
+                code.push_back({IOp::GET_PTR, dst, operand(src), operand(kind.data.get_elem_ptr.index), (int32_t) words(arr->data.array.base)});
+                break;
+            }
+            case KOOPA_RVT_BINARY:
+                code.push_back({(IOp) kind.data.binary.op, dst, operand(kind.data.binary.lhs), operand(kind.data.binary.rhs)});
+                break;
+            case KOOPA_RVT_BRANCH:
+                assert(! kind.data.branch.true_args.len && ! kind.data.branch.false_args.len);
+                code.push_back({IOp::BR, operand(kind.data.branch.cond), block_id.at(kind.data.branch.true_bb), block_id.at(kind.data.branch.false_bb)});
+                break;
+            case KOOPA_RVT_JUMP:
+                assert(! kind.data.jump.args.len);
+                code.push_back({IOp::JUMP, block_id.at(kind.data.jump.target)});
+                break;
+            case KOOPA_RVT_CALL: {
+                const auto & call = kind.data.call;
+                int          args = arg_pool.size();
+                for (size_t k = 0; k < call.args.len; ++k)
+                    arg_pool.push_back(operand((koopa_raw_value_t) call.args.buffer[k]));
+                if (call.callee->bbs.len) {
+                    code.push_back({IOp::CALL, dst, func_id.at(call.callee), args, (int32_t) call.args.len});
+                    break;
+                }
+                auto native = std::find(std::begin(native_names), std::end(native_names), std::string(call.callee->name));
+                assert(native != std::end(native_names));
+                code.push_back({IOp::NATIVE, dst, (int32_t) (native - std::begin(native_names)), args, (int32_t) call.args.len});
+                break;
+            }
+            case KOOPA_RVT_RETURN:
+                code.push_back({IOp::RET, kind.data.ret.value ? operand(kind.data.ret.value) : -1});
+                break;
+            default:
+                assert(false);
+            }
+        }
+    }
+    f.nslots = n;
+}
+
+// 基本块在进入时整块计数, 因此按块的粒度统计
+uint64_t Interpreter::executed() const {
+    uint64_t n = 0;
+    for (const auto & bb : blocks)
+        n += bb.count * bb.size;
+    return n;
+}
+
+bool Interpreter::fault(const std::string & msg) const {
+    std::fprintf(stderr, "run: %s\n", msg.c_str());
+    return false;
+}
+
+bool Interpreter::call_native(int k, const int32_t * args, int32_t & res) {
+    ++native_calls[k];
+    switch (k) {
+    case GETINT:
+        if (std::scanf("%d", &res) != 1)
+            res = 0;
+        return true;
+    case GETCH:
+        res = std::getchar();
+        return true;
+    case GETARRAY: {
+        int n = 0;
+        if (std::scanf("%d", &n) != 1)
+            n = 0;
+        if (n < 0 || ! valid(args[0], n))
+            return fault("getarray out of bounds");
+        for (int i = 0; i < n; ++i)
+            if (std::scanf("%d", &mem[args[0] + i]) != 1)
+                mem[args[0] + i] = 0;
+        res = n;
+        return true;
+    }
+    case PUTINT:
+        std::printf("%d", args[0]);
+        return true;
+    case PUTCH:
+        std::putchar(args[0]);
+        return true;
+    case PUTARRAY:
+        if (args[0] < 0 || ! valid(args[1], args[0]))
+            return fault("putarray out of bounds");
+        std::printf("%d:", args[0]);
+        for (int i = 0; i < args[0]; ++i)
+            std::printf(" %d", mem[args[1] + i]);
+        std::printf("\n");
+        return true;
+    case STARTTIME:
+        timer_insts = executed();
+        return true;
+    case STOPTIME:
+        timed_insts += executed() - timer_insts;
+        ++timers;
+        return true;
+    case MEMSET:
+        if (args[2] < 0 || ! valid(args[0], args[2]))
+            return fault("__sysy_memset out of bounds");
+        std::fill_n(mem.begin() + args[0], args[2], args[1]);
+        return true;
+    case VSUM:
+        if (args[1] < 0 || ! valid(args[0], args[1]))
+            return fault("__sysy_vsum out of bounds");
+        res = 0;
+        for (int i = 0; i < args[1]; ++i)
+            res = (uint32_t) res + mem[args[0] + i];
+        return true;
+    default: {
+        // memcpy(dst, src, n) 与逐元素运算 (dst, a, b 或 x, n), 都与逐个元素正向计算等价
+        bool    copy = k == MEMCPY, vv = k == VADD_VV || k == VSUB_VV || k == VMUL_VV;
+        int32_t n    = copy ? args[2] : args[3];
+        if (n < 0 || ! valid(args[0], n) || ! valid(args[1], n) || (vv && ! valid(args[2], n)))
+            return fault(std::string(native_names[k] + 1) + " out of bounds");
+        for (int32_t i = 0; i < n; ++i) {
+            uint32_t a = mem[args[1] + i], b = vv ? mem[args[2] + i] : args[2];
+            mem[args[0] + i] = copy ? a : k == VADD_VV || k == VADD_VX ? a + b : k == VSUB_VV ? a - b : k == VRSUB_VX ? b - a : a * b;
+        }
+        return true;
+    }
+    }
+}
+
+int Interpreter::run() {
+    if (main_func == -1)
+        return fault("no main function"), 255;
+
+    std::vector<Frame> frames;
+    int                cur  = main_func;
+    uint32_t           base = 0, fp = mem.size(), sp = fp + funcs[cur].frame_words;
+    mem.resize(std::max<size_t>(sp, mem.size() * 2));
+    regs.resize(std::max(funcs[cur].nslots, 1 << 16));
+    std::copy(funcs[cur].consts.begin(), funcs[cur].consts.end(), regs.begin() + funcs[cur].const_base);
+    ++funcs[cur].calls;
+    ++blocks[funcs[cur].entry].count;
+    uint32_t  pc = blocks[funcs[cur].entry].pc;
+    int32_t * r  = regs.data();
+
+    for (;;) {
+        const Code & c = code[pc++];
+        switch (c.op) {
+        case IOp::NE:
+            r[c.a] = r[c.b] != r[c.c];
+            break;
+        case IOp::EQ:
+            r[c.a] = r[c.b] == r[c.c];
+            break;
+        case IOp::GT:
+            r[c.a] = r[c.b] > r[c.c];
+            break;
+        case IOp::LT:
+            r[c.a] = r[c.b] < r[c.c];
+            break;
+        case IOp::GE:
+            r[c.a] = r[c.b] >= r[c.c];
+            break;
+        case IOp::LE:
+            r[c.a] = r[c.b] <= r[c.c];
+            break;
+        case IOp::ADD:
+            r[c.a] = (uint32_t) r[c.b] + r[c.c];
+            break;
+        case IOp::SUB:
+            r[c.a] = (uint32_t) r[c.b] - r[c.c];
+            break;
+        case IOp::MUL:
+            r[c.a] = (uint32_t) r[c.b] * r[c.c];
+            break;
+        // 与 RV32M 一致, INT_MIN / -1 得 INT_MIN, 余数为 0
+        case IOp::DIV:
+            if (! r[c.c])
+                return fault("division by zero in " + funcs[cur].name), 255;
+            r[c.a] = r[c.c] == -1 ? (int32_t) (0u - r[c.b]) : r[c.b] / r[c.c];
+            break;
+        case IOp::MOD:
+            if (! r[c.c])
+                return fault("division by zero in " + funcs[cur].name), 255;
+            r[c.a] = r[c.c] == -1 ? 0 : r[c.b] % r[c.c];
+            break;
+        case IOp::AND:
+            r[c.a] = r[c.b] & r[c.c];
+            break;
+        case IOp::OR:
+            r[c.a] = r[c.b] | r[c.c];
+            break;
+        case IOp::XOR:
+            r[c.a] = r[c.b] ^ r[c.c];
+            break;
+        case IOp::SHL:
+            r[c.a] = (uint32_t) r[c.b] << (r[c.c] & 31);
+            break;
+        case IOp::SHR:
+            r[c.a] = (uint32_t) r[c.b] >> (r[c.c] & 31);
+            break;
+        case IOp::SAR:
+            r[c.a] = r[c.b] >> (r[c.c] & 31);
+            break;
+        case IOp::ALLOC:
+            r[c.a] = fp + c.b;
+            break;
+        case IOp::LOAD:
+            if (! valid(r[c.b], 1))
+                return fault("invalid load in " + funcs[cur].name), 255;
+            r[c.a] = mem[r[c.b]];
+            break;
+        case IOp::STORE:
+            if (! valid(r[c.b], 1))
+                return fault("invalid store in " + funcs[cur].name), 255;
+            mem[r[c.b]] = r[c.a];
+            break;
+        case IOp::GET_PTR:
+            r[c.a] = (uint32_t) r[c.b] + (uint32_t) r[c.c] * c.d;
+            break;
+        case IOp::BR:
+        case IOp::JUMP: {
+            int target = c.op == IOp::JUMP ? c.a : r[c.a] ? c.b : c.c;
+            ++blocks[target].count;
+            pc = blocks[target].pc;
+            break;
+        }
+        case IOp::CALL: {
+            const Function & callee   = funcs[c.b];
+            uint32_t         new_base = base + funcs[cur].nslots;
+            if (sp + callee.frame_words > max_memory_words || new_base + callee.nslots > max_memory_words)
+                return fault("stack overflow in " + callee.name), 255;
+            if (sp + callee.frame_words > mem.size())
+                mem.resize(std::max<size_t>(sp + callee.frame_words, mem.size() * 2));
+            if (new_base + callee.nslots > regs.size())
+                regs.resize(std::max<size_t>(new_base + callee.nslots, regs.size() * 2));
+            r = regs.data() + base;
+            for (int k = 0; k < c.d; ++k)
+                regs[new_base + k] = r[arg_pool[c.c + k]];
+            std::copy(callee.consts.begin(), callee.consts.end(), regs.begin() + new_base + callee.const_base);
+
+            frames.push_back({cur, pc, base, fp, c.a});
+            cur  = c.b;
+            base = new_base;
+            fp   = sp;
+            sp += callee.frame_words;
+            r = regs.data() + base;
+            ++funcs[cur].calls;
+            ++blocks[callee.entry].count;
+            pc = blocks[callee.entry].pc;
+            break;
+        }
+        case IOp::NATIVE: {
+            int32_t args[4] = {}, res = 0;
+            for (int k = 0; k < c.d && k < 4; ++k)
+                args[k] = r[arg_pool[c.c + k]];
+            if (! call_native(c.b, args, res))
+                return 255;
+            if (c.a != -1)
+                r[c.a] = res;
+            break;
+        }
+        case IOp::RET: {
+            int32_t value = c.a != -1 ? r[c.a] : 0;
+            sp            = fp;
+            if (frames.empty()) {
+                std::fflush(stdout);
+                return value & 0xff;
+            }
+            const Frame & caller = frames.back();
+            cur                  = caller.func;
+            pc                   = caller.pc;
+            base                 = caller.base;
+            fp                   = caller.fp;
+            r                    = regs.data() + base;
+            if (caller.dst != -1)
+                r[caller.dst] = value;
+            frames.pop_back();
+            break;
+        }
+        }
+    }
+}
+
+void Interpreter::report(std::ostream & os) const {
+    std::vector<uint64_t> insts(funcs.size(), 0);
+    for (const auto & bb : blocks)
+        insts[bb.func] += bb.count * bb.size;
+    os << "instructions " << executed() << "\n";
+    if (timers)
+        os << "timed (" << timers << " starttime/stoptime): instructions " << timed_insts << "\n";
+    os << "\n";
+
+    // 函数按执行的指令数从多到少排列, 其下按程序中的顺序列出执行过的基本块
+    std::vector<int> order;
+    for (size_t f = 0; f < funcs.size(); ++f)
+        if (funcs[f].calls)
+            order.push_back(f);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return insts[a] > insts[b]; });
+    os << std::left << std::setw(32) << "function / block" << std::right << std::setw(12) << "count" << std::setw(14) << "instructions" << "\n";
+    for (int f : order) {
+        os << std::left << std::setw(32) << funcs[f].name << std::right << std::setw(12) << funcs[f].calls << std::setw(14) << insts[f] << "\n";
+        for (const auto & bb : blocks)
+            if (bb.func == f && bb.count)
+                os << "  " << std::left << std::setw(30) << bb.name << std::right << std::setw(12) << bb.count << std::setw(14) << bb.count * bb.size << "\n";
+    }
+    for (int k = 0; k < NATIVE_COUNT; ++k)
+        if (native_calls[k])
+            os << std::left << std::setw(32) << std::string(native_names[k]) + " (native)" << std::right << std::setw(12) << native_calls[k] << "\n";
+}
+
+int run_koopa_program(const koopa_raw_program_t & raw, std::ostream & report) {
+    Interpreter interp(raw);
+    int         res = interp.run();
+    interp.report(report);
+    return res;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "koopa.h"
+#include <ostream>
+
+// -run 模式: 把 raw 翻译成预先解码的字节码后直接执行, 不经过后端.
+// 程序的输入输出使用 stdin/stdout, add_lib 声明的库函数和编译器内部的运行时例程在本地实现.
+// 执行结束后在 report 中输出每个函数和基本块执行的 IR 指令数; 返回 main 的返回值的低 8 位,
+// 执行出错 (除以 0, 越界访存等) 时在 stderr 说明原因并返回 255
+int run_koopa_program(const koopa_raw_program_t & raw, std::ostream & report);
@@ -1,82 +1,245 @@
 #include "koopa_riscv.h"
+#include "koopa_cfg.h"
+#include "options.h"
+#include "peephole.h"
+#include "profile.h"
+#include "runtime.h"
+#include "rvc.h"
+#include "schedule.h"
+#include "vreg.h"
 #include <algorithm>
 #include <assert.h>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <set>
+#include <unordered_map>
 
-static std::map<koopa_raw_value_t, int> addr;
-
-static int  cur     = 0;
-static int  t_size  = 0;
-static int  cnt_num = 0;
-static bool calling = false;
+static int cnt_num = 0;
 
 static std::string func_name;
 
-int getAddr(koopa_raw_value_t val) {
-    if (addr.count(val))
-        return addr[val];
+static koopa_raw_basic_block_t cur_bb;
+// 输出顺序中紧接在 cur_bb 之后的块, 条件跳转据此决定落入哪一边
+static koopa_raw_basic_block_t next_bb;
+
+// 叶函数的值都放得进调用者保存寄存器时不建栈帧, 每个值住在 home 中的寄存器里.
+// 启用 IPRA 时其他函数的部分值也住在寄存器里, 其余的值仍使用栈槽
+static std::map<koopa_raw_value_t, int> home;
+
+static const uint32_t caller_saved = 1u << RA | 1u << T0 | 1u << T1 | 1u << T2 | 0xffu << A0 | 0xfu << T3;
+
+// 代码生成前对每个函数一次性算好的信息, 按函数在程序中的位置存放
+struct FunctionInfo {
+    int  frame_size    = 0; // 已按 16 字节对齐, 不建栈帧时为 0
+    bool has_call      = false;
+    int  outgoing_args = 0;  // 栈帧底部传出参数区的大小
+    int  scratch_save  = -1; // 启用 C 扩展时保存 s0/s1 的位置, 不使用 s0/s1 时为 -1
+    int  cycle_save    = -1; // -finstrument-cycles 时存放计数器起点等 16 字节的位置, 见 gen_cycle_entry; 不插桩时为 -1
+
+    // 调用它会改写的调用者保存寄存器 (含它调用的函数改写的). 代码生成后才知道, 在此之前按全部改写处理
+    uint32_t clobbers = caller_saved;
+
+    // 非叶函数只在通向调用的路径上保存 ra: 在 ra_save_bb 开头保存, 在 ra_restore_bbs 的 ret 前恢复
+    koopa_raw_basic_block_t           ra_save_bb = nullptr;
+    std::set<koopa_raw_basic_block_t> ra_restore_bbs;
+
+    // 需要栈槽的值按出现顺序编号, slot[编号] 是它相对 sp 的偏移
+    std::unordered_map<koopa_raw_value_t, int> value_id;
+    std::vector<int>                           slot;
+};
+
+static std::vector<FunctionInfo>                     func_info;
+static std::unordered_map<koopa_raw_function_t, int> func_index;
+static const FunctionInfo *                          cur_func;
+static koopa_raw_function_t                          cur_raw_func;
+
+static void analyze_functions(const koopa_raw_program_t & raw, std::vector<int> & order);
+static void analyze_function(const koopa_raw_function_t & func, FunctionInfo & info);
+static void layout_blocks(const koopa_raw_function_t & func);
+
+// 只被 and 使用的 0 - cond 掩码, 启用 Zicond 时直接折叠进 czero.eqz
+static std::set<koopa_raw_value_t> czero_masks;
+
+// 启用 Zbb 时, if-conversion 得到的 "x < y ? x : y" 一类选择用一条 min/max 完成,
+// 选择链上只为它服务的中间值和重复的 load 不再生成
+struct MinMax {
+    Op                op;
+    koopa_raw_value_t lhs, rhs;
+};
+static std::map<koopa_raw_value_t, MinMax> min_max;
+static std::set<koopa_raw_value_t>         folded_selects;
+
+// 被调用到的运行时例程, 其汇编附在程序末尾
+static std::set<std::string> runtime_used;
+
+// -fprofile-generate 时插了计数器的基本块, 下标即计数器在 __sysy_prof_counts 中的位置
+static std::vector<std::string> profiled_blocks;
+static void                     gen_profile_data(std::string & res);
+
+// -finstrument-cycles 时插了计数器的函数, 下标即它在 __sysy_cyc_table 中的项; cur_timer 是当前函数的项
+static std::vector<std::string> timed_functions;
+static int                      cur_timer;
+static void                     gen_cycle_entry(MachineFunction & mf);
+static void                     gen_cycle_exit(MachineFunction & mf);
+static void                     gen_cycle_data(std::string & res);
+
+// 从未被写入, 地址也没有传出的全局数组; 放进 .rodata, 常量下标的读取在编译期折叠
+static std::set<koopa_raw_value_t>                    read_only;
+static std::map<koopa_raw_value_t, koopa_raw_value_t> global_root;
+static std::map<koopa_raw_value_t, int>               folded_loads;
+static std::set<koopa_raw_value_t>                    dead_ptrs;
+
+static void find_read_only_globals(const koopa_raw_program_t & raw);
+
+// 放进 .sdata/.sbss 的小全局变量. gp 始终是启动代码设置的 __global_pointer$, 链接器把这两个段
+// 排在它的 ±2 KiB 之内, 并把 lui %hi(sym) + %lo(sym) 形式的访问松弛成一条 offset(gp) 指令
+static std::set<koopa_raw_value_t> sdata;
 
-    int t = cal_size(val);
-    assert(t > 0);
+static void layout_sdata(const koopa_raw_program_t & raw) {
+    sdata.clear();
 
-    // int t_cur = cur;
-    cur -= t;
-    addr[val] = cur;
-    return cur;
+    // 窗口还要留给库中的小数据
+    int total = 0;
+    for (size_t i = 0; i < raw.values.len; ++i) {
+        auto value = (koopa_raw_value_t) raw.values.buffer[i];
+        int  size  = cal_size(value->ty->data.pointer.base);
+        if (! read_only.count(value) && size <= options.small_data_limit && total + size <= 2048) {
+            sdata.insert(value);
+            total += size;
+        }
+    }
+}
+
+int getAddr(koopa_raw_value_t val) {
+    auto it = cur_func->value_id.find(val);
+    assert(it != cur_func->value_id.end());
+    return cur_func->slot[it->second];
 }
 
-void split(int addr, const std::string & reg, const std::string & t, std::string & res, bool save) {
-    std::string op = save ? "sw" : "lw";
+void split(int addr, int reg, int t, MachineFunction & mf, bool save) {
+    Op op = save ? Op::SW : Op::LW;
     if (addr < -2048 || addr > 2047) {
-        res += "li " + t + ", " + std::to_string(addr) + "\n";
-        res += "add " + t + ", " + t + ", sp\n";
-        res += op + " " + reg + ", 0(" + t + ")\n";
+        mf.emit(Op::LI, mreg(t), mimm(addr));
+        mf.emit(Op::ADD, mreg(t), mreg(t), mreg(SP));
+        mf.emit(op, mreg(reg), mreg(t), mimm(0));
     } else
-        res += op + " " + reg + ", " + std::to_string(addr) + "(sp)\n";
+        mf.emit(op, mreg(reg), mreg(SP), mimm(addr));
+}
+
+static int global_symbol(koopa_raw_value_t global) {
+    return intern(std::string(global->name).substr(1));
+}
+
+static int bb_label(koopa_raw_basic_block_t bb) {
+    return intern(func_name + "_" + std::string(bb->name).substr(1));
 }
 
-void load_reg(koopa_raw_value_t val, const std::string & reg, std::string & res) {
+void load_reg(koopa_raw_value_t val, int reg, MachineFunction & mf) {
     if (val->kind.tag == KOOPA_RVT_INTEGER)
-        res += "li " + reg + ", " + std::to_string(val->kind.data.integer.value) + "\n";
-    else if (val->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-        res += "la t0, " + std::string(val->name).substr(1) + "\n";
-        res += "lw " + reg + ", 0(t0)\n";
-    } else {
+        mf.emit(Op::LI, mreg(reg), mimm(val->kind.data.integer.value));
+    else if (folded_loads.count(val))
+        mf.emit(Op::LI, mreg(reg), mimm(folded_loads[val]));
+    else if (sdata.count(val)) {
+        mf.emit(Op::LUI, mreg(reg), mhi(global_symbol(val)));
+        mf.emit(Op::LW, mreg(reg), mreg(reg), mlo(global_symbol(val)));
+    } else if (val->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+        mf.emit(Op::LA, mreg(reg), msym(global_symbol(val)));
+        mf.emit(Op::LW, mreg(reg), mreg(reg), mimm(0));
+    } else if (home.count(val))
+        mf.emit(Op::MV, mreg(reg), mreg(home[val]));
+    else {
         int addr = getAddr(val);
-        split(addr, reg, "t6", res, false);
+        split(addr, reg, T6, mf, false);
     }
 }
 
+void save_reg(koopa_raw_value_t val, int reg, MachineFunction & mf) {
+    if (home.count(val))
+        mf.emit(Op::MV, mreg(home[val]), mreg(reg));
+    else
+        split(getAddr(val), reg, T6, mf, true);
+}
+
 std::string gen_riscv_from_koopa_raw_program(const koopa_raw_program_t & raw) {
     std::string res;
+
+    find_read_only_globals(raw);
+    layout_sdata(raw);
+    if (! options.profile_use.empty() && ! load_profile(options.profile_use, raw))
+        std::cerr << "cannot read profile: " << options.profile_use << std::endl;
+    std::vector<int> order;
+    analyze_functions(raw, order);
+
     res += ".data\n";
+    for (size_t i = 0; i < raw.values.len; ++i)
+        if (! read_only.count((koopa_raw_value_t) raw.values.buffer[i]) && ! sdata.count((koopa_raw_value_t) raw.values.buffer[i]))
+            gen_global_alloc((koopa_raw_value_t) raw.values.buffer[i], res);
 
-    Visit(raw.values, res);
+    if (! read_only.empty()) {
+        res += ".section .rodata\n";
+        for (size_t i = 0; i < raw.values.len; ++i)
+            if (read_only.count((koopa_raw_value_t) raw.values.buffer[i]))
+                gen_global_alloc((koopa_raw_value_t) raw.values.buffer[i], res);
+    }
+
+    // 有初值的小全局变量放进 .sdata, 全零的放进 .sbss
+    for (bool zero : {false, true}) {
+        bool first = true;
+        for (size_t i = 0; i < raw.values.len; ++i) {
+            auto value = (koopa_raw_value_t) raw.values.buffer[i];
+            if (! sdata.count(value) || (value->kind.data.global_alloc.init->kind.tag == KOOPA_RVT_ZERO_INIT) != zero)
+                continue;
+            if (first)
+                res += zero ? ".section .sbss\n.align 2\n" : ".section .sdata\n.align 2\n";
+            first = false;
+            gen_global_alloc(value, res);
+        }
+    }
 
     res += ".text\n";
+    if (options.rvc)
+        res += ".option rvc\n";
+
+    // 被调用者先生成, 调用者分配寄存器时就知道它实际改写哪些寄存器; 输出仍按程序中的顺序
+    std::vector<std::string> text(raw.funcs.len);
+    for (int i : order) {
+        auto func = (koopa_raw_function_t) raw.funcs.buffer[i];
+        analyze_function(func, func_info[i]);
+        if (has_profile(func))
+            layout_blocks(func);
+        Visit(func, text[i]);
+    }
+    for (const auto & t : text)
+        res += t;
 
-    Visit(raw.funcs, res);
+    if (options.peephole_stats)
+        dump_peephole_stats(std::cerr);
+    if (options.code_size_report)
+        dump_code_size(std::cerr);
+
+    for (const auto & name : runtime_used)
+        res += runtime_asm(name);
+    if (options.profile_generate)
+        gen_profile_data(res);
+    if (options.instrument_cycles)
+        gen_cycle_data(res);
 
     return res;
 }
 
-void Visit(const koopa_raw_slice_t & slice, std::string & res) {
+void Visit(const koopa_raw_slice_t & slice, MachineFunction & mf) {
     for (size_t i = 0; i < slice.len; ++i) {
         auto ptr = slice.buffer[i];
         // 根据 slice 的 kind 决定将 ptr 视作何种元素
         switch (slice.kind) {
-        case KOOPA_RSIK_FUNCTION:
-            // 访问函数
-            Visit(reinterpret_cast<koopa_raw_function_t>(ptr), res);
-            break;
         case KOOPA_RSIK_BASIC_BLOCK:
             // 访问基本块
-            Visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr), res);
+            Visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr), mf);
             break;
         case KOOPA_RSIK_VALUE:
             // 访问指令
-            Visit(reinterpret_cast<koopa_raw_value_t>(ptr), res);
+            Visit(reinterpret_cast<koopa_raw_value_t>(ptr), mf);
             break;
         default:
             // 我们暂时不会遇到其他内容, 于是不对其做任何处理
@@ -85,100 +248,866 @@ void Visit(const koopa_raw_slice_t & slice, std::string & res) {
     }
 }
 
+static void for_each_operand(koopa_raw_value_t value, const std::function<void(koopa_raw_value_t)> & f) {
+    const auto & kind = value->kind;
+    switch (kind.tag) {
+    case KOOPA_RVT_LOAD:
+        f(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        f(kind.data.store.value);
+        f(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        f(kind.data.get_ptr.src);
+        f(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        f(kind.data.get_elem_ptr.src);
+        f(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        if (min_max.count(value)) {
+            f(min_max[value].lhs);
+            f(min_max[value].rhs);
+        } else {
+            f(kind.data.binary.lhs);
+            f(kind.data.binary.rhs);
+        }
+        break;
+    case KOOPA_RVT_BRANCH:
+        f(kind.data.branch.cond);
+        break;
+    case KOOPA_RVT_CALL:
+        for (size_t i = 0; i < kind.data.call.args.len; ++i)
+            f((koopa_raw_value_t) kind.data.call.args.buffer[i]);
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)
+            f(kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+}
+
+static bool is_bool_value(koopa_raw_value_t value) {
+    if (value->kind.tag != KOOPA_RVT_BINARY)
+        return false;
+    switch (value->kind.data.binary.op) {
+    case KOOPA_RBO_NOT_EQ:
+    case KOOPA_RBO_EQ:
+    case KOOPA_RBO_GT:
+    case KOOPA_RBO_LT:
+    case KOOPA_RBO_GE:
+    case KOOPA_RBO_LE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void find_czero_masks(const koopa_raw_function_t & func) {
+    if (! options.zicond)
+        return;
+
+    std::set<koopa_raw_value_t> other_use;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+
+            const auto & binary = inst->kind.data.binary;
+            if (inst->kind.tag == KOOPA_RVT_BINARY && binary.op == KOOPA_RBO_SUB && binary.lhs->kind.tag == KOOPA_RVT_INTEGER && binary.lhs->kind.data.integer.value == 0 && is_bool_value(binary.rhs))
+                czero_masks.insert(inst);
+
+            bool is_and = inst->kind.tag == KOOPA_RVT_BINARY && binary.op == KOOPA_RBO_AND && binary.lhs != binary.rhs;
+            for_each_operand(inst, [&](koopa_raw_value_t op) {
+                if (! is_and)
+                    other_use.insert(op);
+            });
+        }
+    }
+    for (auto val : other_use)
+        czero_masks.erase(val);
+}
+
+static const koopa_raw_binary_t * as_binary(koopa_raw_value_t value, koopa_raw_binary_op_t op) {
+    return value->kind.tag == KOOPA_RVT_BINARY && value->kind.data.binary.op == op ? &value->kind.data.binary : nullptr;
+}
+
+// 识别 res = e ^ ((t ^ e) & (0 - (cmp != 0))), 其中 cmp 比较的正是 t 和 e
+static void find_min_max(const koopa_raw_function_t & func) {
+    if (! options.zbb)
+        return;
+
+    std::set<koopa_raw_value_t> candidates;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+
+        // 相等的常量, 以及同一基本块中间没有 store 和调用的两次 load 视为相同的值
+        std::unordered_map<koopa_raw_value_t, int> pos;
+        std::vector<int>                           clobbers;
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            pos[inst] = j;
+            if (inst->kind.tag == KOOPA_RVT_STORE || inst->kind.tag == KOOPA_RVT_CALL)
+                clobbers.push_back(j);
+        }
+        auto same = [&](koopa_raw_value_t a, koopa_raw_value_t b) {
+            if (a == b)
+                return true;
+            if (a->kind.tag == KOOPA_RVT_INTEGER && b->kind.tag == KOOPA_RVT_INTEGER)
+                return a->kind.data.integer.value == b->kind.data.integer.value;
+            if (a->kind.tag != KOOPA_RVT_LOAD || b->kind.tag != KOOPA_RVT_LOAD || a->kind.data.load.src != b->kind.data.load.src || ! pos.count(a) || ! pos.count(b))
+                return false;
+            int lo = std::min(pos[a], pos[b]), hi = std::max(pos[a], pos[b]);
+            return std::lower_bound(clobbers.begin(), clobbers.end(), lo) == std::upper_bound(clobbers.begin(), clobbers.end(), hi);
+        };
+
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto res = (koopa_raw_value_t) bb->insts.buffer[j];
+            auto top = as_binary(res, KOOPA_RBO_XOR);
+            for (int k = 0; top && k < 2 && ! min_max.count(res); ++k) {
+                auto e    = k ? top->rhs : top->lhs;
+                auto pick = k ? top->lhs : top->rhs;
+                auto a    = as_binary(pick, KOOPA_RBO_AND);
+                if (! a)
+                    continue;
+                for (int l = 0; l < 2; ++l) {
+                    auto diff = l ? a->rhs : a->lhs;
+                    auto mask = l ? a->lhs : a->rhs;
+                    auto d    = as_binary(diff, KOOPA_RBO_XOR);
+                    auto m    = as_binary(mask, KOOPA_RBO_SUB);
+                    auto c    = m ? as_binary(m->rhs, KOOPA_RBO_NOT_EQ) : nullptr;
+                    if (! d || ! m || ! c || m->lhs->kind.tag != KOOPA_RVT_INTEGER || m->lhs->kind.data.integer.value != 0)
+                        continue;
+                    if (c->rhs->kind.tag != KOOPA_RVT_INTEGER || c->rhs->kind.data.integer.value != 0 || c->lhs->kind.tag != KOOPA_RVT_BINARY)
+                        continue;
+
+                    auto cmp  = c->lhs;
+                    auto cop  = cmp->kind.data.binary.op;
+                    bool less = cop == KOOPA_RBO_LT || cop == KOOPA_RBO_LE;
+                    if (! less && cop != KOOPA_RBO_GT && cop != KOOPA_RBO_GE)
+                        continue;
+
+                    koopa_raw_value_t t;
+                    if (same(d->rhs, e))
+                        t = d->lhs;
+                    else if (same(d->lhs, e))
+                        t = d->rhs;
+                    else
+                        continue;
+
+                    auto x = cmp->kind.data.binary.lhs, y = cmp->kind.data.binary.rhs;
+                    Op   op;
+                    if (same(t, x) && same(e, y))
+                        op = less ? Op::MIN : Op::MAX;
+                    else if (same(t, y) && same(e, x))
+                        op = less ? Op::MAX : Op::MIN;
+                    else
+                        continue;
+
+                    min_max[res] = {op, x, y};
+                    for (auto v : {pick, diff, mask, m->rhs, cmp, d->lhs, d->rhs, e})
+                        if (v != x && v != y && (v->kind.tag == KOOPA_RVT_BINARY || v->kind.tag == KOOPA_RVT_LOAD))
+                            candidates.insert(v);
+                    break;
+                }
+            }
+        }
+    }
+    if (min_max.empty())
+        return;
+
+    // 只有所有使用者都被省去的值才能省去
+    std::map<koopa_raw_value_t, std::vector<koopa_raw_value_t>> users;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            for_each_operand(inst, [&](koopa_raw_value_t op) { users[op].push_back(inst); });
+        }
+    }
+    for (auto & [res, mm] : min_max)
+        candidates.erase(res);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto it = candidates.begin(); it != candidates.end();) {
+            bool dead = true;
+            for (auto user : users[*it])
+                dead = dead && candidates.count(user);
+            if (dead)
+                ++it;
+            else {
+                it      = candidates.erase(it);
+                changed = true;
+            }
+        }
+    }
+    folded_selects.insert(candidates.begin(), candidates.end());
+}
+
+static void for_each_inst(const koopa_raw_program_t & raw, const std::function<void(koopa_raw_value_t)> & f) {
+    for (size_t i = 0; i < raw.funcs.len; ++i) {
+        auto func = (koopa_raw_function_t) raw.funcs.buffer[i];
+        for (size_t j = 0; j < func->bbs.len; ++j) {
+            auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[j];
+            for (size_t k = 0; k < bb->insts.len; ++k)
+                f((koopa_raw_value_t) bb->insts.buffer[k]);
+        }
+    }
+}
+
+// 指针指向哪个全局数组的内部, 不是时返回 nullptr
+static koopa_raw_value_t root_of(koopa_raw_value_t ptr) {
+    if (ptr->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+        return ptr;
+    auto it = global_root.find(ptr);
+    return it == global_root.end() ? nullptr : it->second;
+}
+
+// 沿常量下标的 getelemptr 链从初值中取出 ptr 指向的部分. 遇到 zeroinit 时 elem 就是这个
+// zeroinit 本身, 其类型是外层的数组, 但它的每个元素都是 0
+static bool fold_element(koopa_raw_value_t ptr, koopa_raw_value_t & elem) {
+    if (ptr->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+        elem = ptr->kind.data.global_alloc.init;
+        return true;
+    }
+    if (ptr->kind.tag != KOOPA_RVT_GET_ELEM_PTR)
+        return false;
+
+    const auto &      get = ptr->kind.data.get_elem_ptr;
+    koopa_raw_value_t arr;
+    if (get.index->kind.tag != KOOPA_RVT_INTEGER || ! fold_element(get.src, arr))
+        return false;
+
+    int i = get.index->kind.data.integer.value;
+    if (i < 0 || i >= (int) get.src->ty->data.pointer.base->data.array.len)
+        return false;
+    if (arr->kind.tag == KOOPA_RVT_ZERO_INIT)
+        elem = arr;
+    else
+        elem = (koopa_raw_value_t) arr->kind.data.aggregate.elems.buffer[i];
+    return true;
+}
+
+static void find_read_only_globals(const koopa_raw_program_t & raw) {
+    read_only.clear();
+    global_root.clear();
+    folded_loads.clear();
+    dead_ptrs.clear();
+
+    for (size_t i = 0; i < raw.values.len; ++i) {
+        auto value = (koopa_raw_value_t) raw.values.buffer[i];
+        if (value->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY)
+            read_only.insert(value);
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for_each_inst(raw, [&](koopa_raw_value_t inst) {
+            if ((inst->kind.tag == KOOPA_RVT_GET_ELEM_PTR || inst->kind.tag == KOOPA_RVT_GET_PTR) && ! global_root.count(inst))
+                if (auto root = root_of(inst->kind.data.get_elem_ptr.src)) {
+                    global_root[inst] = root;
+                    changed           = true;
+                }
+        });
+    }
+
+    // 被写入, 或者地址被存起来/传给函数, 都不再只读
+    for_each_inst(raw, [&](koopa_raw_value_t inst) {
+        if (inst->kind.tag == KOOPA_RVT_STORE) {
+            if (auto root = root_of(inst->kind.data.store.dest))
+                read_only.erase(root);
+            if (auto root = root_of(inst->kind.data.store.value))
+                read_only.erase(root);
+        } else if (inst->kind.tag == KOOPA_RVT_CALL)
+            for (size_t i = 0; i < inst->kind.data.call.args.len; ++i)
+                if (auto root = root_of((koopa_raw_value_t) inst->kind.data.call.args.buffer[i]))
+                    read_only.erase(root);
+    });
+
+    std::map<koopa_raw_value_t, int> uses;
+    for_each_inst(raw, [&](koopa_raw_value_t inst) {
+        koopa_raw_value_t elem;
+        if (inst->kind.tag == KOOPA_RVT_LOAD && read_only.count(root_of(inst->kind.data.load.src)) && fold_element(inst->kind.data.load.src, elem)) {
+            if (elem->kind.tag == KOOPA_RVT_INTEGER)
+                folded_loads[inst] = elem->kind.data.integer.value;
+            else if (elem->kind.tag == KOOPA_RVT_ZERO_INIT && inst->ty->tag == KOOPA_RTT_INT32)
+                folded_loads[inst] = 0;
+        }
+        if (! folded_loads.count(inst))
+            for_each_operand(inst, [&](koopa_raw_value_t op) { ++uses[op]; });
+    });
+
+    // 只被折叠掉的读取使用的地址计算也不必生成
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto & [ptr, root] : global_root)
+            if (read_only.count(root) && ! dead_ptrs.count(ptr) && ! uses[ptr]) {
+                dead_ptrs.insert(ptr);
+                --uses[ptr->kind.data.get_elem_ptr.src];
+                changed = true;
+            }
+    }
+}
+
+static bool needs_slot(koopa_raw_value_t value) {
+    return cal_size(value) && ! folded_loads.count(value) && ! czero_masks.count(value) && ! folded_selects.count(value) && ! dead_ptrs.count(value);
+}
+
+static bool is_return(koopa_raw_basic_block_t bb) {
+    return ((koopa_raw_value_t) bb->insts.buffer[bb->insts.len - 1])->kind.tag == KOOPA_RVT_RETURN;
+}
+
+// 基本块的估计执行次数: 有剖析数据时用实际次数, 否则循环中的块算 8 次
+static int64_t block_weight(const koopa_raw_function_t & func, const FunctionCFG & cfg, int b) {
+    if (has_profile(func))
+        return block_count(cfg.blocks[b]);
+    return cfg.in_loop[b] ? 8 : 1;
+}
+
+// 一次调用会改写的寄存器. 运行时例程, 外部函数和交给线程池执行的函数按全部改写处理
+static uint32_t call_clobbers(const koopa_raw_call_t & call) {
+    std::string callee = std::string(call.callee->name).substr(1);
+    if (! options.ipa_ra || ! call.callee->bbs.len || callee.compare(0, 13, "__sysy_doall_") == 0)
+        return caller_saved;
+    return func_info[func_index[call.callee]].clobbers;
+}
+
+// 在按出现顺序排列的指令上做线性扫描. 值的活跃区间从定义到最后一次使用,
+// 区间跨过回边的目标时延长到回边所在块的末尾. partial 为假时寄存器不够就放弃, 仍使用栈帧;
+// 为真时放不下的值留在栈槽里, 按读写的估计次数决定把谁留在栈槽. 跨过调用的值只放进这次调用不改写的寄存器,
+// 作为参数被这次调用读取的值不放进参数寄存器
+static bool assign_homes(const koopa_raw_function_t & func, bool partial) {
+    FunctionCFG                          cfg(func);
+    std::map<koopa_raw_value_t, int>     start, end;
+    std::map<koopa_raw_value_t, int64_t> weight;
+    std::vector<koopa_raw_value_t>       order;
+    std::vector<int>                 bb_start, bb_end;
+
+    // 每次调用的位置, 跨过它的值不能用的寄存器, 以及它的参数寄存器
+    struct CallSite {
+        int      pos;
+        uint32_t across, args;
+    };
+    std::vector<CallSite> calls;
+
+    int pos = 0;
+    for (int b = 0; b < (int) cfg.blocks.size(); ++b) {
+        auto bb = cfg.blocks[b];
+        bb_start.push_back(pos);
+        for (size_t j = 0; j < bb->insts.len; ++j, ++pos) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            if (inst->kind.tag == KOOPA_RVT_ALLOC && inst->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY) {
+                if (! partial)
+                    return false;
+                continue;
+            }
+            if (inst->kind.tag == KOOPA_RVT_CALL) {
+                uint32_t args = ((1u << std::min<int>(inst->kind.data.call.args.len, 8)) - 1) << A0 | 1u << A0;
+                calls.push_back({pos, call_clobbers(inst->kind.data.call) | args, args});
+            }
+            if (needs_slot(inst)) {
+                start[inst] = end[inst] = pos;
+                weight[inst] = block_weight(func, cfg, b);
+                order.push_back(inst);
+            }
+        }
+        bb_end.push_back(pos - 1);
+    }
+
+    pos = 0;
+    for (int b = 0; b < (int) cfg.blocks.size(); ++b) {
+        auto bb = cfg.blocks[b];
+        for (size_t j = 0; j < bb->insts.len; ++j, ++pos)
+            for_each_operand((koopa_raw_value_t) bb->insts.buffer[j], [&](koopa_raw_value_t op) {
+                // 被折叠进 czero.eqz 的掩码由使用者直接读取它的条件
+                if (czero_masks.count(op))
+                    op = op->kind.data.binary.rhs;
+                if (start.count(op)) {
+                    start[op] = std::min(start[op], pos);
+                    end[op]   = std::max(end[op], pos);
+                    weight[op] += block_weight(func, cfg, b);
+                }
+            });
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int b = 0; b < (int) cfg.blocks.size(); ++b)
+            for (int h : cfg.succ[b])
+                if (h <= b)
+                    for (auto v : order)
+                        if (start[v] < bb_start[h] && end[v] >= bb_start[h] && end[v] < bb_end[b]) {
+                            end[v]  = bb_end[b];
+                            changed = true;
+                        }
+    }
+
+    // a0 和还没存进局部变量的参数寄存器不能用
+    std::vector<int> pool = {T5, T4, T3};
+    for (size_t i = 7; i >= std::max<size_t>(func->params.len, 1); --i)
+        pool.push_back(A0 + i);
+
+    std::sort(order.begin(), order.end(), [&](koopa_raw_value_t a, koopa_raw_value_t b) { return start[a] < start[b]; });
+    std::map<koopa_raw_value_t, int> reg;
+    std::vector<koopa_raw_value_t>           active;
+    for (auto v : order) {
+        for (auto it = active.begin(); it != active.end();)
+            if (end[*it] <= start[v]) {
+                pool.push_back(reg[*it]);
+                it = active.erase(it);
+            } else
+                ++it;
+
+        uint32_t forbidden = 0;
+        for (const auto & call : calls)
+            if (start[v] < call.pos && call.pos <= end[v])
+                forbidden |= end[v] > call.pos ? call.across : call.args;
+        auto r = pool.rbegin();
+        while (r != pool.rend() && forbidden >> *r & 1)
+            ++r;
+        if (r == pool.rend()) {
+            if (! partial)
+                return false;
+            // 把占着 v 能用的寄存器且读写最少的值换回栈槽, 它比 v 更常用时 v 留在栈槽
+            auto victim = active.end();
+            for (auto it = active.begin(); it != active.end(); ++it)
+                if (! (forbidden >> reg[*it] & 1) && (victim == active.end() || weight[*it] < weight[*victim]))
+                    victim = it;
+            if (victim != active.end() && weight[*victim] < weight[v]) {
+                reg[v] = reg[*victim];
+                reg.erase(*victim);
+                *victim = v;
+            }
+            continue;
+        }
+        reg[v] = *r;
+        pool.erase(std::next(r).base());
+        active.push_back(v);
+    }
+    home.insert(reg.begin(), reg.end());
+    return true;
+}
+
+// -fregalloc=fast 使用的局部分配: 不建 CFG, 逐块线性扫描一遍. 只在一个块内定义和使用,
+// 且不跨过调用的值放进寄存器, 寄存器不够或跨块, 跨调用的值使用栈槽
+static void assign_local_homes(const koopa_raw_function_t & func) {
+    // 每个值所在的块和最后一次使用的位置, 在其他块中被使用时 last 记为 -1
+    std::unordered_map<koopa_raw_value_t, std::pair<koopa_raw_basic_block_t, int>> def;
+
+    int pos = 0;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j, ++pos) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            for_each_operand(inst, [&](koopa_raw_value_t op) {
+                if (czero_masks.count(op))
+                    op = op->kind.data.binary.rhs;
+                auto it = def.find(op);
+                if (it != def.end())
+                    it->second.second = it->second.first == bb && it->second.second != -1 ? pos : -1;
+            });
+            if (needs_slot(inst) && inst->kind.tag != KOOPA_RVT_ALLOC)
+                def[inst] = {bb, pos};
+        }
+    }
+
+    std::vector<int> all = {T5, T4, T3};
+    for (size_t i = 7; i >= std::max<size_t>(func->params.len, 1); --i)
+        all.push_back(A0 + i);
+
+    pos = 0;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto                             bb   = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        std::vector<int>                 pool = all;
+        std::vector<std::pair<int, int>> busy; // (最后一次使用的位置, 寄存器)
+
+        // next_call[j]: 块中第 j 条及之后的第一个调用的下标, 没有时为块长
+        std::vector<size_t> next_call(bb->insts.len + 1, bb->insts.len);
+        for (size_t j = bb->insts.len; j-- > 0;)
+            next_call[j] = ((koopa_raw_value_t) bb->insts.buffer[j])->kind.tag == KOOPA_RVT_CALL ? j : next_call[j + 1];
+
+        for (size_t j = 0; j < bb->insts.len; ++j, ++pos) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            for (auto it = busy.begin(); it != busy.end();)
+                if (it->first <= pos) {
+                    pool.push_back(it->second);
+                    it = busy.erase(it);
+                } else
+                    ++it;
+
+            auto it = def.find(inst);
+            if (it == def.end() || it->second.second <= pos)
+                continue;
+            int last = it->second.second;
+
+            // 区间内有调用时, 只允许最后一次使用就是这次调用, 且不放进它的参数寄存器
+            uint32_t forbidden = 0;
+            size_t   k         = next_call[j + 1];
+            int      call_pos  = pos + (int) (k - j);
+            if (k < bb->insts.len && call_pos < last)
+                continue;
+            if (k < bb->insts.len && call_pos == last)
+                forbidden = ((1u << std::min<int>(((koopa_raw_value_t) bb->insts.buffer[k])->kind.data.call.args.len, 8)) - 1) << A0 | 1u << A0;
+            auto r = pool.rbegin();
+            while (r != pool.rend() && forbidden >> *r & 1)
+                ++r;
+            if (r == pool.rend())
+                continue;
+            home[inst] = *r;
+            busy.push_back({last, *r});
+            pool.erase(std::next(r).base());
+        }
+    }
+}
+
+// DOALL 的 worker 同时在多个线程中执行, 对全局计数器的读-改-写会互相覆盖, 因此不插桩;
+// 在主线程中执行的那一段计入调用者
+static bool is_doall_worker(const koopa_raw_function_t & func) {
+    return std::string(func->name).compare(0, 14, "@__sysy_doall_") == 0;
+}
+
+// 插桩时 main 在每个返回前调用运行时例程输出统计
+static bool calls_at_return(const koopa_raw_function_t & func) {
+    return (options.profile_generate || options.instrument_cycles) && std::string(func->name) == "@main";
+}
+
+// 保存点取所有调用块及调用之后可能到达的返回块的最近公共支配者, 并提到循环之外,
+// 这样它在每条通向调用的路径上恰好执行一次, 而提前返回的路径不必碰 ra
+static void place_ra_save(const koopa_raw_function_t & func, FunctionInfo & info) {
+    FunctionCFG cfg(func);
+    int         n = cfg.blocks.size();
+
+    std::vector<bool> after_call(n, false);
+    std::vector<int>  work;
+    for (int b = 0; b < n; ++b)
+        for (size_t j = 0; j < cfg.blocks[b]->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) cfg.blocks[b]->insts.buffer[j];
+            bool call = inst->kind.tag == KOOPA_RVT_CALL || (inst->kind.tag == KOOPA_RVT_RETURN && calls_at_return(func));
+            if (call && cfg.reachable(b) && ! after_call[b]) {
+                after_call[b] = true;
+                work.push_back(b);
+            }
+        }
+
+    int s = work.empty() ? 0 : work[0];
+    for (int b : work)
+        s = cfg.common_dominator(s, b);
+    while (! work.empty()) {
+        int b = work.back();
+        work.pop_back();
+        if (is_return(cfg.blocks[b]))
+            s = cfg.common_dominator(s, b);
+        for (int t : cfg.succ[b])
+            if (! after_call[t]) {
+                after_call[t] = true;
+                work.push_back(t);
+            }
+    }
+    while (cfg.in_loop[s])
+        s = cfg.idom[s];
+
+    info.ra_save_bb = cfg.blocks[s];
+    for (int b = 0; b < n; ++b)
+        if (is_return(cfg.blocks[b]) && cfg.dominates(s, b))
+            info.ra_restore_bbs.insert(cfg.blocks[b]);
+}
+
+// 栈帧底部的传出参数区, 大小取所有调用中第 9 个及以后参数所需空间的最大值
+static int outgoing_args_size(const koopa_raw_function_t & func) {
+    int size = 0;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            if (inst->kind.tag == KOOPA_RVT_CALL)
+                size = std::max(size, ((int) inst->kind.data.call.args.len - 8) * 4);
+        }
+    }
+    return size;
+}
+
+// 按每字节的估计读写次数从少到多排序 (见 block_weight); 大数组因此排在前面
+static void sort_by_use_weight(const koopa_raw_function_t & func, std::vector<koopa_raw_value_t> & values) {
+    FunctionCFG                                    cfg(func);
+    std::unordered_map<koopa_raw_value_t, int64_t> weight;
+    for (size_t i = 0; i < cfg.blocks.size(); ++i) {
+        auto w  = block_weight(func, cfg, i);
+        auto bb = cfg.blocks[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            weight[inst] += w;
+            for_each_operand(inst, [&](koopa_raw_value_t op) { weight[op] += w; });
+        }
+    }
+    std::stable_sort(values.begin(), values.end(), [&](koopa_raw_value_t a, koopa_raw_value_t b) {
+        return weight[a] * cal_size(b) < weight[b] * cal_size(a);
+    });
+}
+
+static void analyze_function(const koopa_raw_function_t & func, FunctionInfo & info) {
+    bool                           timed = options.instrument_cycles && ! is_doall_worker(func);
+    std::vector<koopa_raw_value_t> values;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            if (inst->kind.tag == KOOPA_RVT_CALL)
+                info.has_call = true;
+            if (needs_slot(inst))
+                values.push_back(inst);
+        }
+    }
+    info.outgoing_args = outgoing_args_size(func);
+    if (calls_at_return(func))
+        info.has_call = true;
+
+    if (info.has_call)
+        place_ra_save(func, info);
+    if (options.fast_regalloc)
+        assign_local_homes(func);
+    else if (! info.has_call && assign_homes(func, false)) {
+        if (timed) {
+            info.frame_size = 16;
+            info.cycle_save = 0;
+        }
+        return;
+    } else if (options.ipa_ra)
+        assign_homes(func, true);
+    values.erase(std::remove_if(values.begin(), values.end(), [](koopa_raw_value_t value) { return home.count(value); }), values.end());
+
+    int size = info.outgoing_args + (info.has_call ? 4 : 0);
+    for (auto value : values)
+        size += cal_size(value);
+    if (timed)
+        size += 16;
+    if (size && options.rvc)
+        size += 8;
+    info.frame_size = size ? ((size - 1) / 16 + 1) * 16 : 0;
+    if (size && options.rvc)
+        info.scratch_save = info.frame_size - (info.has_call ? 4 : 0) - 8;
+
+    // 启用 C 扩展时让常用的值排在后面, 即靠近 sp, 尽量落进 c.lwsp/c.swsp 能编码的偏移范围
+    if (options.rvc)
+        sort_by_use_weight(func, values);
+
+    // ra, s0/s1 和计数器的起点在栈帧顶部, 值的栈槽在它们下面依次排列
+    int cur = info.frame_size - (info.has_call ? 4 : 0) - (info.scratch_save != -1 ? 8 : 0);
+    if (timed) {
+        cur -= 16;
+        info.cycle_save = cur;
+    }
+    for (auto value : values) {
+        cur -= cal_size(value);
+        info.value_id[value] = info.slot.size();
+        info.slot.push_back(cur);
+    }
+}
+
+// 按剖析数据重排基本块: 从入口出发, 每次把执行最多的未放置后继接在后面,
+// 链断开时按原来的顺序接上剩下的块中第一个执行过的. 从未执行的块因此集中在函数末尾
+static void layout_blocks(const koopa_raw_function_t & func) {
+    FunctionCFG               cfg(func);
+    int                       n = cfg.blocks.size();
+    std::vector<bool>         placed(n, false);
+    std::vector<const void *> layout;
+    for (int b = 0; b != -1;) {
+        placed[b] = true;
+        layout.push_back(cfg.blocks[b]);
+        int next = -1;
+        for (int s : cfg.succ[b])
+            if (! placed[s] && (next == -1 || block_count(cfg.blocks[s]) > block_count(cfg.blocks[next])))
+                next = s;
+        for (int c = 0; c < n && next == -1; ++c)
+            if (! placed[c] && block_count(cfg.blocks[c]))
+                next = c;
+        for (int c = 0; c < n && next == -1; ++c)
+            if (! placed[c])
+                next = c;
+        b = next;
+    }
+    std::copy(layout.begin(), layout.end(), func->bbs.buffer);
+}
+
+// 调用图的后序: 被调用者排在调用者之前, 递归时环上先访问到的函数排在后面
+static void post_order(const koopa_raw_function_t & func, std::vector<bool> & visited, std::vector<int> & order) {
+    int index = func_index[func];
+    if (visited[index])
+        return;
+    visited[index] = true;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            if (inst->kind.tag == KOOPA_RVT_CALL)
+                post_order(inst->kind.data.call.callee, visited, order);
+        }
+    }
+    if (func->bbs.len)
+        order.push_back(index);
+}
+
+static void analyze_functions(const koopa_raw_program_t & raw, std::vector<int> & order) {
+    czero_masks.clear();
+    min_max.clear();
+    folded_selects.clear();
+    home.clear();
+    func_index.clear();
+    func_info.assign(raw.funcs.len, FunctionInfo());
+
+    for (size_t i = 0; i < raw.funcs.len; ++i) {
+        auto func        = (koopa_raw_function_t) raw.funcs.buffer[i];
+        func_index[func] = i;
+        if (func->bbs.len) {
+            find_czero_masks(func);
+            find_min_max(func);
+        }
+    }
+
+    std::vector<bool> visited(raw.funcs.len, false);
+    for (size_t i = 0; i < raw.funcs.len; ++i)
+        post_order((koopa_raw_function_t) raw.funcs.buffer[i], visited, order);
+}
+
+// 函数生成的代码改写的调用者保存寄存器, 加上它调用的函数改写的
+static uint32_t function_clobbers(const koopa_raw_function_t & func, const MachineFunction & mf) {
+    uint32_t res = 0;
+    for (const auto & inst : mf.insts)
+        if (defines_first(inst.op) && inst.ops[0].kind == MOperand::Reg)
+            res |= 1u << inst.ops[0].value;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[i];
+        for (size_t j = 0; j < bb->insts.len; ++j) {
+            auto inst = (koopa_raw_value_t) bb->insts.buffer[j];
+            if (inst->kind.tag == KOOPA_RVT_CALL)
+                res |= 1u << RA | call_clobbers(inst->kind.data.call);
+        }
+    }
+    return res & caller_saved;
+}
+
 void Visit(const koopa_raw_function_t & func, std::string & res) {
     // 执行一些其他的必要操作
     if (func->bbs.len == 0)
         return;
 
-    const char * name = func->name + 1;
-    res += std::string(".globl ") + name + "\n";
-    res += std::string(name) + ":\n";
+    cur_func     = &func_info[func_index[func]];
+    cur_raw_func = func;
+    func_name    = std::string(func->name).substr(1);
 
-    bool call = false;
-    int  size = cal_size(func, call);
+    MachineFunction mf;
+    mf.label(intern(func_name));
 
+    int size = cur_func->frame_size;
     if (size) {
-        size = ((size - 1) / 16 + 1) * 16;
         if (-size < -2048 || -size > 2047) {
-            res += std::string("li t0, ") + std::to_string(-size) + "\n";
-            res += std::string("add sp, sp, t0") + "\n";
+            mf.emit(Op::LI, mreg(T6), mimm(-size));
+            mf.emit(Op::ADD, mreg(SP), mreg(SP), mreg(T6));
         } else
-            res += std::string("addi sp, sp, ") + std::to_string(-size) + "\n";
+            mf.emit(Op::ADDI, mreg(SP), mreg(SP), mimm(-size));
     }
-
-    if (call) {
-        int offset = size - 4;
-        if (offset < -2048 || offset > 2047) {
-            res += std::string("li t0, ") + std::to_string(offset) + "\n";
-            res += std::string("add t0, sp, t0") + "\n";
-            res += std::string("sw ra, 0(t0)") + "\n";
-        } else
-            res += std::string("sw ra, ") + std::to_string(offset) + "(sp)\n";
+    if (cur_func->scratch_save != -1) {
+        split(cur_func->scratch_save, S0, T6, mf, true);
+        split(cur_func->scratch_save + 4, S1, T6, mf, true);
+    }
+    if (cur_func->cycle_save != -1) {
+        cur_timer = timed_functions.size();
+        timed_functions.push_back(func_name);
+        gen_cycle_entry(mf);
     }
 
-    t_size  = size;
-    calling = call;
-    cur     = size - (calling ? 4 : 0);
-    addr.clear();
+    // 访问所有基本块
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+        next_bb = i + 1 < func->bbs.len ? (koopa_raw_basic_block_t) func->bbs.buffer[i + 1] : nullptr;
+        Visit((koopa_raw_basic_block_t) func->bbs.buffer[i], mf);
+    }
+    assign_vregs(mf);
 
-    func_name = std::string(func->name).substr(1);
+    if (options.peephole)
+        peephole(mf);
+    if (cur_func->scratch_save != -1)
+        use_compressible_scratch(mf);
+    if (options.schedule)
+        schedule(mf);
+    if (options.code_size_report)
+        count_code_size(mf);
+    func_info[func_index[func]].clobbers = function_clobbers(func, mf);
 
-    // 访问所有基本块
-    Visit(func->bbs, res);
+    res += ".globl " + func_name + "\n";
+    print_function(mf, res);
 }
 
-void Visit(const koopa_raw_basic_block_t & bb, std::string & res) {
+void Visit(const koopa_raw_basic_block_t & bb, MachineFunction & mf) {
     // 执行一些其他的必要操作
-    res += func_name + "_" + std::string(bb->name).substr(1) + ":\n";
+    mf.label(bb_label(bb));
+    if (options.profile_generate && ! is_doall_worker(cur_raw_func)) {
+        int offset = profiled_blocks.size() * 4, count = mf.new_vreg();
+        profiled_blocks.push_back(profile_key(cur_raw_func, bb));
+        mf.emit(Op::LA, mreg(T6), msym(intern("__sysy_prof_counts")));
+        if (offset > 2047) {
+            mf.emit(Op::LI, mreg(count), mimm(offset));
+            mf.emit(Op::ADD, mreg(T6), mreg(T6), mreg(count));
+            offset = 0;
+        }
+        mf.emit(Op::LW, mreg(count), mreg(T6), mimm(offset));
+        mf.emit(Op::ADDI, mreg(count), mreg(count), mimm(1));
+        mf.emit(Op::SW, mreg(count), mreg(T6), mimm(offset));
+    }
+    if (cur_func->has_call && bb == cur_func->ra_save_bb)
+        split(cur_func->frame_size - 4, RA, T6, mf, true);
+    cur_bb = bb;
 
     // 访问所有指令
-    Visit(bb->insts, res);
+    Visit(bb->insts, mf);
 }
 
-void Visit(const koopa_raw_value_t & value, std::string & res) {
+void Visit(const koopa_raw_value_t & value, MachineFunction & mf) {
     // 根据指令类型判断后续需要如何访问
     const auto & kind = value->kind;
     switch (kind.tag) {
-    case KOOPA_RVT_INTEGER:
-        res += std::to_string(kind.data.integer.value) + "\n";
-        break;
     case KOOPA_RVT_ALLOC:
         break;
-    case KOOPA_RVT_GLOBAL_ALLOC:
-        gen_global_alloc(value, res);
-        break;
     case KOOPA_RVT_LOAD:
-        load_reg(kind.data.load.src, "t0", res);
-        if (kind.data.load.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR || kind.data.load.src->kind.tag == KOOPA_RVT_GET_PTR)
-            res += "lw t0, 0(t0)\n";
-        split(getAddr(value), "t0", "t6", res, true);
+        if (! folded_loads.count(value) && ! folded_selects.count(value)) {
+            int reg = mf.new_vreg();
+            load_reg(kind.data.load.src, reg, mf);
+            if (kind.data.load.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR || kind.data.load.src->kind.tag == KOOPA_RVT_GET_PTR)
+                mf.emit(Op::LW, mreg(reg), mreg(reg), mimm(0));
+            save_reg(value, reg, mf);
+        }
         break;
     case KOOPA_RVT_STORE:
-        gen_store(kind.data.store, res);
+        gen_store(kind.data.store, mf);
         break;
     case KOOPA_RVT_GET_PTR:
-        gen_get_ptr(kind.data.get_ptr, getAddr(value), res);
+        if (! dead_ptrs.count(value))
+            gen_get_ptr(kind.data.get_ptr, value, mf);
         break;
     case KOOPA_RVT_GET_ELEM_PTR:
-        gen_get_elem_ptr(kind.data.get_elem_ptr, getAddr(value), res);
+        if (! dead_ptrs.count(value))
+            gen_get_elem_ptr(kind.data.get_elem_ptr, value, mf);
         break;
     case KOOPA_RVT_RETURN:
-        gen_return(kind.data.ret, res);
+        gen_return(kind.data.ret, mf);
         break;
     case KOOPA_RVT_BRANCH:
-        gen_branch(kind.data.branch, res);
+        gen_branch(kind.data.branch, mf);
         break;
 
     case KOOPA_RVT_JUMP:
-        res += "j " + func_name + "_" + std::string(kind.data.jump.target->name).substr(1) + "\n";
+        mf.emit(Op::J, msym(bb_label(kind.data.jump.target)));
         break;
 
     case KOOPA_RVT_CALL:
-        gen_call(kind.data.call, value->ty->tag == KOOPA_RTT_UNIT ? -1 : getAddr(value), res);
+        gen_call(kind.data.call, value->ty->tag == KOOPA_RTT_UNIT ? nullptr : value, mf);
         break;
 
     case KOOPA_RVT_BINARY:
-        gen_binary(kind.data.binary, getAddr(value), res);
+        if (! czero_masks.count(value) && ! folded_selects.count(value))
+            gen_binary(kind.data.binary, value, mf);
         break;
 
     default:
@@ -186,27 +1115,6 @@ void Visit(const koopa_raw_value_t & value, std::string & res) {
     }
 }
 
-int cal_size(const koopa_raw_function_t & func, bool & call) {
-    int total_size = 0;
-    for (size_t i = 0; i < func->bbs.len; ++i) {
-        const void * data = func->bbs.buffer[i];
-        total_size += cal_size((koopa_raw_basic_block_t) data, call);
-    }
-    total_size += call ? 4 : 0;
-    return total_size;
-}
-
-int cal_size(const koopa_raw_basic_block_t & bb, bool & call) {
-    int total_size = 0;
-    for (size_t i = 0; i < bb->insts.len; ++i) {
-        const void * data = bb->insts.buffer[i];
-        if (((koopa_raw_value_t) data)->kind.tag == KOOPA_RVT_CALL)
-            call = true;
-        total_size += cal_size((koopa_raw_value_t) data);
-    }
-    return total_size;
-}
-
 int cal_size(const koopa_raw_value_t & value) {
     if (value->kind.tag == KOOPA_RVT_ALLOC)
         return cal_size(value->ty->data.pointer.base);
@@ -239,185 +1147,260 @@ void gen_global_alloc(koopa_raw_value_t alloc, std::string & res) {
         res += ".word " + std::to_string(alloc->kind.data.global_alloc.init->kind.data.integer.value) + "\n";
 }
 
-void gen_store(const koopa_raw_store_t & store, std::string & res) {
-    std::string dest;
+void gen_store(const koopa_raw_store_t & store, MachineFunction & mf) {
+    // 存到 offset(base), 或者目的地本身就住在寄存器 dest 里
+    int      base = mf.new_vreg(), dest = -1;
+    MOperand offset = mimm(0);
 
-    if (store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-        res += "la t1, " + std::string(store.dest->name).substr(1) + "\n";
-        dest = "0(t1)";
-    } else if (store.dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR || store.dest->kind.tag == KOOPA_RVT_GET_PTR) {
-        load_reg(store.dest, "t1", res);
-        dest = "0(t1)";
-    } else {
+    if (sdata.count(store.dest)) {
+        mf.emit(Op::LUI, mreg(base), mhi(global_symbol(store.dest)));
+        offset = mlo(global_symbol(store.dest));
+    } else if (store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+        mf.emit(Op::LA, mreg(base), msym(global_symbol(store.dest)));
+    else if (store.dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR || store.dest->kind.tag == KOOPA_RVT_GET_PTR)
+        load_reg(store.dest, base, mf);
+    else if (home.count(store.dest))
+        dest = home[store.dest];
+    else {
         int addr = getAddr(store.dest);
         if (addr < -2048 || addr > 2047) {
-            res += "li t1, " + std::to_string(addr) + "\n";
-            res += "add t1, t1, sp\n";
-            dest = "0(t1)";
-        } else
-            dest = std::to_string(addr) + "(sp)";
+            mf.emit(Op::LI, mreg(base), mimm(addr));
+            mf.emit(Op::ADD, mreg(base), mreg(base), mreg(SP));
+        } else {
+            base   = SP;
+            offset = mimm(addr);
+        }
     }
 
+    int reg = mf.new_vreg();
     if (store.value->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
         if (store.value->kind.data.func_arg_ref.index < 8)
-            res += "sw a" + std::to_string(store.value->kind.data.func_arg_ref.index) + ", " + dest + "\n";
+            reg = A0 + store.value->kind.data.func_arg_ref.index;
         else {
-            int offset = (store.value->kind.data.func_arg_ref.index - 8) * 4;
-            split(offset, "t0", "t2", res, false);
-            res += "sw t0, " + dest + "\n";
+            int offset = cur_func->frame_size + (store.value->kind.data.func_arg_ref.index - 8) * 4;
+            split(offset, reg, mf.new_vreg(), mf, false);
         }
-    } else {
-        load_reg(store.value, "t0", res);
-        res += "sw t0, " + dest + "\n";
-    }
+    } else
+        load_reg(store.value, reg, mf);
+
+    if (dest != -1)
+        mf.emit(Op::MV, mreg(dest), mreg(reg));
+    else
+        mf.emit(Op::SW, mreg(reg), mreg(base), offset);
+}
+
+// ptr += index * n. 启用 Zba 时, n 为 2^k (k <= 3) 或其 3/5/9 倍的情况用 sh{k}add 完成
+static void add_scaled_index(int ptr, int index, int n, MachineFunction & mf) {
+    static const Op shadd[] = {Op::ADD, Op::SH1ADD, Op::SH2ADD, Op::SH3ADD};
+    if (options.zba)
+        for (int k = 3; k > 0; --k) {
+            if (n % (1 << k))
+                continue;
+            int m = n >> k;
+            if (m == 3 || m == 5 || m == 9)
+                mf.emit(shadd[m == 3 ? 1 : m == 5 ? 2 : 3], mreg(index), mreg(index), mreg(index));
+            else if (m != 1)
+                continue;
+            mf.emit(shadd[k], mreg(ptr), mreg(index), mreg(ptr));
+            return;
+        }
+
+    int size = mf.new_vreg();
+    mf.emit(Op::LI, mreg(size), mimm(n));
+    mf.emit(Op::MUL, mreg(index), mreg(index), mreg(size));
+    mf.emit(Op::ADD, mreg(ptr), mreg(ptr), mreg(index));
 }
 
-void gen_get_ptr(const koopa_raw_get_ptr_t & get, int addr, std::string & res) {
-    int src = getAddr(get.src);
-    split(src, "t0", "t0", res, false);
+void gen_get_ptr(const koopa_raw_get_ptr_t & get, koopa_raw_value_t value, MachineFunction & mf) {
+    int ptr = mf.new_vreg(), index = mf.new_vreg();
+    load_reg(get.src, ptr, mf);
 
-    load_reg(get.index, "t1", res);
+    load_reg(get.index, index, mf);
 
-    int n = cal_size(get.src->ty->data.pointer.base);
-    res += "li t2, " + std::to_string(n) + "\n";
-    res += "mul t1, t1, t2\n";
-    res += "add t0, t0, t1\n";
+    add_scaled_index(ptr, index, cal_size(get.src->ty->data.pointer.base), mf);
 
-    split(addr, "t0", "t6", res, true);
+    save_reg(value, ptr, mf);
 }
 
-void gen_get_elem_ptr(const koopa_raw_get_elem_ptr_t & get, int addr, std::string & res) {
-    if (get.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
-        res += "la t0, " + std::string(get.src->name).substr(1) + "\n";
+void gen_get_elem_ptr(const koopa_raw_get_elem_ptr_t & get, koopa_raw_value_t value, MachineFunction & mf) {
+    int ptr = mf.new_vreg(), index = mf.new_vreg();
+    if (sdata.count(get.src)) {
+        mf.emit(Op::LUI, mreg(ptr), mhi(global_symbol(get.src)));
+        mf.emit(Op::ADDI, mreg(ptr), mreg(ptr), mlo(global_symbol(get.src)));
+    } else if (get.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+        mf.emit(Op::LA, mreg(ptr), msym(global_symbol(get.src)));
+    else if (get.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR || get.src->kind.tag == KOOPA_RVT_GET_PTR)
+        load_reg(get.src, ptr, mf);
     else {
         int src = getAddr(get.src);
         if (src < -2048 || src > 2047) {
-            res += "li t0, " + std::to_string(src) + "\n";
-            res += "add t0, sp, t0\n";
+            mf.emit(Op::LI, mreg(ptr), mimm(src));
+            mf.emit(Op::ADD, mreg(ptr), mreg(SP), mreg(ptr));
         } else
-            res += "addi t0, sp, " + std::to_string(src) + "\n";
-
-        if (get.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR || get.src->kind.tag == KOOPA_RVT_GET_PTR)
-            res += "lw t0, 0(t0)\n";
+            mf.emit(Op::ADDI, mreg(ptr), mreg(SP), mimm(src));
     }
 
-    load_reg(get.index, "t1", res);
-    int n = cal_size(get.src->ty->data.pointer.base->data.array.base);
-    res += "li t2, " + std::to_string(n) + "\n";
-    res += "mul t1, t1, t2\n";
-    res += "add t0, t0, t1\n";
+    load_reg(get.index, index, mf);
+    add_scaled_index(ptr, index, cal_size(get.src->ty->data.pointer.base->data.array.base), mf);
 
-    split(addr, "t0", "t6", res, true);
+    save_reg(value, ptr, mf);
 }
 
-void gen_branch(const koopa_raw_branch_t & branch, std::string & res) {
-    load_reg(branch.cond, "t0", res);
-    res += "beqz t0, " + func_name + "_skip" + std::to_string(cnt_num) + "\n";
-    res += "j " + func_name + "_" + std::string(branch.true_bb->name).substr(1) + "\n";
-    res += func_name + "_skip" + std::to_string(cnt_num++) + ":\n";
-    res += "j " + func_name + "_" + std::string(branch.false_bb->name).substr(1) + "\n";
+void gen_branch(const koopa_raw_branch_t & branch, MachineFunction & mf) {
+    int skip = intern(func_name + "_skip" + std::to_string(cnt_num++));
+    int cond = mf.new_vreg();
+    load_reg(branch.cond, cond, mf);
+    // 条件分支的范围有限, 总是只跳过一条 j; 真分支紧接在后面时让它直接落入
+    if (branch.true_bb == next_bb) {
+        mf.emit(Op::BNEZ, mreg(cond), msym(skip));
+        mf.emit(Op::J, msym(bb_label(branch.false_bb)));
+        mf.label(skip);
+        return;
+    }
+    mf.emit(Op::BEQZ, mreg(cond), msym(skip));
+    mf.emit(Op::J, msym(bb_label(branch.true_bb)));
+    mf.label(skip);
+    mf.emit(Op::J, msym(bb_label(branch.false_bb)));
 }
 
-void gen_call(const koopa_raw_call_t & call, int addr, std::string & res) {
-    for (int i = 0; i < call.args.len && i < 8; ++i) {
-        char reg[3] = "a0";
-        reg[1] += i;
-        load_reg((koopa_raw_value_t) call.args.buffer[i], reg, res);
-    }
+void gen_call(const koopa_raw_call_t & call, koopa_raw_value_t value, MachineFunction & mf) {
+    for (int i = 0; i < call.args.len && i < 8; ++i)
+        load_reg((koopa_raw_value_t) call.args.buffer[i], A0 + i, mf);
 
-    bool func_call = false;
-    int  func_sz   = cal_size(call.callee, func_call);
-    if (func_sz)
-        func_sz = ((func_sz - 1) / 16 + 1) * 16;
     for (int i = 8; i < call.args.len; ++i) {
-        load_reg((koopa_raw_value_t) call.args.buffer[i], "t0", res);
-        int offset = (i - 8) * 4 - func_sz;
-        split(offset, "t0", "t6", res, true);
+        int arg = mf.new_vreg();
+        load_reg((koopa_raw_value_t) call.args.buffer[i], arg, mf);
+        split((i - 8) * 4, arg, T6, mf, true);
     }
-    res += "call " + std::string(call.callee->name).substr(1) + "\n";
-    if (addr != -1)
-        split(addr, "a0", "t6", res, true);
+    std::string callee = std::string(call.callee->name).substr(1);
+
+    // 从 DOALL 循环提取出的函数交给运行时分段并行执行
+    if (callee.compare(0, 13, "__sysy_doall_") == 0) {
+        mf.emit(Op::LA, mreg(T3), msym(intern(callee)));
+        callee = "__sysy_parallel_for";
+    }
+    if (runtime_asm(callee))
+        runtime_used.insert(callee);
+    mf.emit(Op::CALL, msym(intern(callee)));
+    if (value)
+        save_reg(value, A0, mf);
 }
 
-void gen_return(const koopa_raw_return_t & ret, std::string & res) {
+void gen_return(const koopa_raw_return_t & ret, MachineFunction & mf) {
+    if (options.profile_generate && func_name == "main") {
+        runtime_used.insert("__sysy_prof_dump");
+        mf.emit(Op::CALL, msym(intern("__sysy_prof_dump")));
+    }
     if (ret.value)
-        load_reg(ret.value, "a0", res);
-    if (calling)
-        split(t_size - 4, "ra", "t6", res, false);
+        load_reg(ret.value, A0, mf);
+    if (cur_func->cycle_save != -1)
+        gen_cycle_exit(mf);
+    if (options.instrument_cycles && func_name == "main") {
+        runtime_used.insert("__sysy_cyc_dump");
+        mf.emit(Op::CALL, msym(intern("__sysy_cyc_dump")));
+    }
+    if (cur_func->has_call && cur_func->ra_restore_bbs.count(cur_bb))
+        split(cur_func->frame_size - 4, RA, T6, mf, false);
+    if (cur_func->scratch_save != -1) {
+        split(cur_func->scratch_save, S0, T6, mf, false);
+        split(cur_func->scratch_save + 4, S1, T6, mf, false);
+    }
 
-    if (t_size) {
-        int sz = t_size;
+    if (cur_func->frame_size) {
+        int sz = cur_func->frame_size;
         if (sz < -2048 || sz > 2047) {
-            res += "li t0, " + std::to_string(sz) + "\n";
-            res += "add sp, sp, t0\n";
+            mf.emit(Op::LI, mreg(T6), mimm(sz));
+            mf.emit(Op::ADD, mreg(SP), mreg(SP), mreg(T6));
         } else
-            res += "addi sp, sp, " + std::to_string(sz) + "\n";
+            mf.emit(Op::ADDI, mreg(SP), mreg(SP), mimm(sz));
     }
-    res += "ret\n";
+    mf.emit(Op::RET);
 }
 
-void gen_binary(const koopa_raw_binary_t & binary, int addr, std::string & res) {
-    load_reg(binary.lhs, "t0", res);
-    load_reg(binary.rhs, "t1", res);
+void gen_binary(const koopa_raw_binary_t & binary, koopa_raw_value_t value, MachineFunction & mf) {
+    if (min_max.count(value)) {
+        const auto & mm  = min_max[value];
+        int          lhs = mf.new_vreg(), rhs = mf.new_vreg(), result = mf.new_vreg();
+        load_reg(mm.lhs, lhs, mf);
+        load_reg(mm.rhs, rhs, mf);
+        mf.emit(mm.op, mreg(result), mreg(lhs), mreg(rhs));
+        save_reg(value, result, mf);
+        return;
+    }
 
-    std::string result("t0"), lhs("t0"), rhs("t1");
+    // x & (0 - cond) 即 cond ? x : 0, 可用一条 czero.eqz 完成
+    if (binary.op == KOOPA_RBO_AND && (czero_masks.count(binary.lhs) || czero_masks.count(binary.rhs))) {
+        koopa_raw_value_t mask = czero_masks.count(binary.lhs) ? binary.lhs : binary.rhs;
+        int               x = mf.new_vreg(), cond = mf.new_vreg(), result = mf.new_vreg();
+        load_reg(mask == binary.lhs ? binary.rhs : binary.lhs, x, mf);
+        load_reg(mask->kind.data.binary.rhs, cond, mf);
+        mf.emit(Op::CZERO_EQZ, mreg(result), mreg(x), mreg(cond));
+        save_reg(value, result, mf);
+        return;
+    }
+
+    MOperand result = mreg(mf.new_vreg()), lhs = mreg(mf.new_vreg()), rhs = mreg(mf.new_vreg());
+    load_reg(binary.lhs, lhs.value, mf);
+    load_reg(binary.rhs, rhs.value, mf);
 
     switch (binary.op) {
     case KOOPA_RBO_SUB:
-        res += "sub " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::SUB, result, lhs, rhs);
         break;
     case KOOPA_RBO_ADD:
-        res += "add " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::ADD, result, lhs, rhs);
         break;
     case KOOPA_RBO_MUL:
-        res += "mul " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::MUL, result, lhs, rhs);
         break;
     case KOOPA_RBO_DIV:
-        res += "div " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::DIV, result, lhs, rhs);
         break;
     case KOOPA_RBO_MOD:
-        res += "rem " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::REM, result, lhs, rhs);
         break;
     case KOOPA_RBO_LT:
-        res += "slt " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::SLT, result, lhs, rhs);
         break;
     case KOOPA_RBO_LE:
-        res += "sgt " + result + ", " + rhs + ", " + lhs + "\n";
+        mf.emit(Op::SGT, result, lhs, rhs);
+        mf.emit(Op::XORI, result, result, mimm(1));
         break;
     case KOOPA_RBO_GT:
-        res += "sgt " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::SGT, result, lhs, rhs);
         break;
     case KOOPA_RBO_GE:
-        res += "slt " + result + ", " + rhs + ", " + lhs + "\n";
+        mf.emit(Op::SLT, result, lhs, rhs);
+        mf.emit(Op::XORI, result, result, mimm(1));
         break;
     case KOOPA_RBO_AND:
-        res += "and " + result + ", " + rhs + ", " + lhs + "\n";
+        mf.emit(Op::AND, result, rhs, lhs);
         break;
     case KOOPA_RBO_OR:
-        res += "or " + result + ", " + rhs + ", " + lhs + "\n";
+        mf.emit(Op::OR, result, rhs, lhs);
         break;
     case KOOPA_RBO_NOT_EQ:
-        res += "xor " + result + ", " + lhs + ", " + rhs + "\n";
-        res += "snez " + result + ", " + result + "\n";
+        mf.emit(Op::XOR, result, lhs, rhs);
+        mf.emit(Op::SNEZ, result, result);
         break;
     case KOOPA_RBO_EQ:
-        res += "xor " + result + ", " + lhs + ", " + rhs + "\n";
-        res += "seqz " + result + ", " + result + "\n";
+        mf.emit(Op::XOR, result, lhs, rhs);
+        mf.emit(Op::SEQZ, result, result);
         break;
     case KOOPA_RBO_XOR:
-        res += "xor " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::XOR, result, lhs, rhs);
         break;
     case KOOPA_RBO_SHL:
-        res += "sll " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::SLL, result, lhs, rhs);
         break;
     case KOOPA_RBO_SHR:
-        res += "srl " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::SRL, result, lhs, rhs);
         break;
     case KOOPA_RBO_SAR:
-        res += "sra " + result + ", " + lhs + ", " + rhs + "\n";
+        mf.emit(Op::SRA, result, lhs, rhs);
         break;
     }
-    split(addr, "t0", "t6", res, true);
+    save_reg(value, result.value, mf);
 }
 
 void gen_aggregate(koopa_raw_value_t val, std::string & res) {
@@ -427,3 +1410,92 @@ void gen_aggregate(koopa_raw_value_t val, std::string & res) {
     } else
         res += ".word " + std::to_string(val->kind.data.integer.value) + "\n";
 }
+
+static void gen_profile_data(std::string & res) {
+    res += ".data\n.align 2\n__sysy_prof_counts:\n.zero " + std::to_string(profiled_blocks.size() * 4) + "\n";
+    res += "__sysy_prof_path:\n.asciz \"";
+    for (char c : options.profile_generate_path)
+        res += c == '"' || c == '\\' ? std::string("\\") + c : std::string(1, c);
+    res += "\"\n__sysy_prof_names:\n";
+    for (const auto & name : profiled_blocks)
+        res += ".asciz \"" + name + " \"\n";
+    res += ".byte 0\n";
+}
+
+// 入口处把调用者到目前为止的子调用累计 (__sysy_cyc_child) 存进栈帧并清零, 再读计数器的起点.
+// cycle_save 处: +0 起点 cycle, +4 起点 instret, +8/+12 调用者的子调用 cycle/instret
+static void gen_cycle_entry(MachineFunction & mf) {
+    int save = cur_func->cycle_save;
+    mf.emit(Op::LA, mreg(T6), msym(intern("__sysy_cyc_child")));
+    for (int k = 0; k < 2; ++k) {
+        int child = mf.new_vreg();
+        mf.emit(Op::LW, mreg(child), mreg(T6), mimm(4 * k));
+        split(save + 8 + 4 * k, child, mf.new_vreg(), mf, true);
+        mf.emit(Op::SW, mreg(ZERO), mreg(T6), mimm(4 * k));
+    }
+    int instret = mf.new_vreg(), cycle = mf.new_vreg();
+    mf.emit(Op::RDINSTRET, mreg(instret));
+    split(save + 4, instret, mf.new_vreg(), mf, true);
+    mf.emit(Op::RDCYCLE, mreg(cycle));
+    split(save, cycle, mf.new_vreg(), mf, true);
+}
+
+// t6 指向 __sysy_cyc_table 中当前函数的项, 返回项相对 t6 的偏移
+static int cycle_table_entry(MachineFunction & mf) {
+    int offset = cur_timer * 36;
+    mf.emit(Op::LA, mreg(T6), msym(intern("__sysy_cyc_table")));
+    if (offset + 32 <= 2047)
+        return offset;
+    int t = mf.new_vreg();
+    mf.emit(Op::LI, mreg(t), mimm(offset));
+    mf.emit(Op::ADD, mreg(T6), mreg(T6), mreg(t));
+    return 0;
+}
+
+// 把 reg 加到 offset(t6) 处高位字在前的 64 位计数上, 改写 reg
+static void add_counter64(int offset, int reg, MachineFunction & mf) {
+    int low = mf.new_vreg();
+    mf.emit(Op::LW, mreg(low), mreg(T6), mimm(offset + 4));
+    mf.emit(Op::ADD, mreg(low), mreg(low), mreg(reg));
+    mf.emit(Op::SW, mreg(low), mreg(T6), mimm(offset + 4));
+    mf.emit(Op::SLTU, mreg(low), mreg(low), mreg(reg));
+    mf.emit(Op::LW, mreg(reg), mreg(T6), mimm(offset));
+    mf.emit(Op::ADD, mreg(reg), mreg(reg), mreg(low));
+    mf.emit(Op::SW, mreg(reg), mreg(T6), mimm(offset));
+}
+
+// 返回前算出本次调用经过的 cycle/instret (含子调用), 计入调用者的子调用累计, 减去自己的子调用得到自身部分.
+// 表项: +0 调用次数, +4 含子调用 cycle, +12 自身 cycle, +20 含子调用 instret, +28 自身 instret
+static void gen_cycle_exit(MachineFunction & mf) {
+    int save = cur_func->cycle_save;
+    for (int k = 0; k < 2; ++k) {
+        int total = mf.new_vreg(), self = mf.new_vreg(), child = mf.new_vreg();
+        mf.emit(k ? Op::RDINSTRET : Op::RDCYCLE, mreg(total));
+        split(save + 4 * k, self, self, mf, false);
+        mf.emit(Op::SUB, mreg(total), mreg(total), mreg(self));
+        mf.emit(Op::LA, mreg(T6), msym(intern("__sysy_cyc_child")));
+        mf.emit(Op::LW, mreg(self), mreg(T6), mimm(4 * k));
+        split(save + 8 + 4 * k, child, child, mf, false);
+        mf.emit(Op::ADD, mreg(child), mreg(child), mreg(total));
+        mf.emit(Op::SW, mreg(child), mreg(T6), mimm(4 * k));
+        mf.emit(Op::SUB, mreg(self), mreg(total), mreg(self));
+
+        int entry = cycle_table_entry(mf);
+        if (! k) {
+            int calls = mf.new_vreg();
+            mf.emit(Op::LW, mreg(calls), mreg(T6), mimm(entry));
+            mf.emit(Op::ADDI, mreg(calls), mreg(calls), mimm(1));
+            mf.emit(Op::SW, mreg(calls), mreg(T6), mimm(entry));
+        }
+        add_counter64(entry + 4 + 16 * k, total, mf);
+        add_counter64(entry + 12 + 16 * k, self, mf);
+    }
+}
+
+static void gen_cycle_data(std::string & res) {
+    res += ".bss\n.align 2\n__sysy_cyc_child:\n.zero 8\n__sysy_cyc_table:\n.zero " + std::to_string(timed_functions.size() * 36) + "\n";
+    res += ".section .rodata\n__sysy_cyc_names:\n";
+    for (const auto & name : timed_functions)
+        res += ".asciz \"" + name + "\"\n";
+    res += ".byte 0\n";
+}
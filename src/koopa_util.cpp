@@ -5,7 +5,7 @@
 
 char * make_char_arr(std::string str) {
     size_t n   = str.length();
-    char * res = new char(n + 1);
+    char * res = new char[n + 1];
     str.copy(res, n + 1);
     res[n] = 0;
     return res;
@@ -22,6 +22,10 @@ koopa_raw_value_t make_number_koopa(int number) {
     return res;
 }
 
+bool is_zero_koopa(koopa_raw_value_t value) {
+    return value->kind.tag == KOOPA_RVT_INTEGER && value->kind.data.integer.value == 0;
+}
+
 koopa_raw_slice_t empty_koopa_rs(koopa_raw_slice_item_kind_t kind) {
     koopa_raw_slice_t res;
     res.buffer = nullptr;
@@ -165,3 +169,75 @@ koopa_raw_value_data_t * set_ptr(koopa_raw_value_t src, koopa_raw_value_t index,
 
     return get;
 }
+
+koopa_raw_value_data * make_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+    koopa_raw_value_data * res = new koopa_raw_value_data();
+
+    res->ty                   = simple_koopa_raw_type_kind(KOOPA_RTT_INT32);
+    res->name                 = nullptr;
+    res->used_by              = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    res->kind.tag             = KOOPA_RVT_BINARY;
+    res->kind.data.binary.op  = op;
+    res->kind.data.binary.lhs = lhs;
+    res->kind.data.binary.rhs = rhs;
+    return res;
+}
+
+koopa_raw_value_data * make_load(koopa_raw_value_t src) {
+    koopa_raw_value_data * res = new koopa_raw_value_data();
+
+    res->ty                 = src->ty->data.pointer.base;
+    res->name               = nullptr;
+    res->used_by            = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    res->kind.tag           = KOOPA_RVT_LOAD;
+    res->kind.data.load.src = src;
+    return res;
+}
+
+koopa_raw_value_data * make_store(koopa_raw_value_t value, koopa_raw_value_t dest) {
+    koopa_raw_value_data * res = new koopa_raw_value_data();
+
+    res->ty                    = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
+    res->name                  = nullptr;
+    res->used_by               = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    res->kind.tag              = KOOPA_RVT_STORE;
+    res->kind.data.store.value = value;
+    res->kind.data.store.dest  = dest;
+    return res;
+}
+
+koopa_raw_value_data * make_branch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) {
+    koopa_raw_value_data * res = new koopa_raw_value_data();
+
+    res->ty                          = simple_koopa_raw_type_kind(KOOPA_RTT_UNIT);
+    res->name                        = nullptr;
+    res->used_by                     = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    res->kind.tag                    = KOOPA_RVT_BRANCH;
+    res->kind.data.branch.cond       = cond;
+    res->kind.data.branch.true_bb    = true_bb;
+    res->kind.data.branch.false_bb   = false_bb;
+    res->kind.data.branch.true_args  = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    res->kind.data.branch.false_args = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    return res;
+}
+
+koopa_raw_basic_block_data_t * make_block(const std::string & name) {
+    koopa_raw_basic_block_data_t * res = new koopa_raw_basic_block_data_t();
+
+    res->name    = make_char_arr(name);
+    res->params  = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    res->used_by = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    return res;
+}
+
+koopa_raw_value_data * make_call(koopa_raw_function_t func, const std::vector<const void *> & args) {
+    koopa_raw_value_data * res = new koopa_raw_value_data();
+
+    res->ty                    = func->ty->data.function.ret;
+    res->name                  = nullptr;
+    res->used_by               = empty_koopa_rs(KOOPA_RSIK_VALUE);
+    res->kind.tag              = KOOPA_RVT_CALL;
+    res->kind.data.call.callee = func;
+    res->kind.data.call.args   = make_koopa_rs_from_vector(args, KOOPA_RSIK_VALUE);
+    return res;
+}
@@ -9,6 +9,8 @@ char * make_char_arr(std::string str);
 
 koopa_raw_value_t make_number_koopa(int number);
 
+bool is_zero_koopa(koopa_raw_value_t value);
+
 koopa_raw_slice_t empty_koopa_rs(koopa_raw_slice_item_kind_t kind = KOOPA_RSIK_UNKNOWN);
 
 koopa_raw_slice_t make_koopa_rs_single_element(const void * ele, koopa_raw_slice_item_kind_t kind = KOOPA_RSIK_UNKNOWN);
@@ -32,3 +34,15 @@ koopa_raw_value_data * make_alloc_type(const std::string & name, koopa_raw_type_
 koopa_raw_value_data * make_zero_init(koopa_raw_type_kind * ty = nullptr);
 
 koopa_raw_value_data_t * set_ptr(koopa_raw_value_t src, koopa_raw_value_t index = nullptr, bool new_ty = true, koopa_raw_value_tag_t tag = KOOPA_RVT_GET_ELEM_PTR);
+
+koopa_raw_value_data * make_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+
+koopa_raw_value_data * make_load(koopa_raw_value_t src);
+
+koopa_raw_value_data * make_store(koopa_raw_value_t value, koopa_raw_value_t dest);
+
+koopa_raw_value_data * make_branch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb);
+
+koopa_raw_basic_block_data_t * make_block(const std::string & name);
+
+koopa_raw_value_data * make_call(koopa_raw_function_t func, const std::vector<const void *> & args);
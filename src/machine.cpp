@@ -0,0 +1,112 @@
+#include "machine.h"
+#include <cassert>
+#include <unordered_map>
+
+static std::vector<std::string>             symbols;
+static std::unordered_map<std::string, int> symbol_id;
+
+int intern(const std::string & name) {
+    auto it = symbol_id.find(name);
+    if (it != symbol_id.end())
+        return it->second;
+    symbols.push_back(name);
+    return symbol_id[name] = symbols.size() - 1;
+}
+
+const std::string & symbol_name(int sym) {
+    return symbols[sym];
+}
+
+static const char * op_names[] = {
+    "li", "la", "lui", "mv", "seqz", "snez",
+    "add", "sub", "mul", "div", "rem", "slt", "sgt", "sltu", "xor", "or", "and", "sll", "srl", "sra", "czero.eqz",
+    "sh1add", "sh2add", "sh3add", "min", "max",
+    "addi", "slti", "xori", "ori", "andi",
+    "lw", "sw",
+    "rdcycle", "rdinstret",
+    "j", "beqz", "bnez", "call", "ret"};
+
+static_assert(sizeof(op_names) / sizeof(op_names[0]) == (size_t) Op::COUNT);
+
+static const char * reg_names[] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+const char * op_name(Op op) {
+    return op_names[(int) op];
+}
+
+bool parse_op(const std::string & name, Op & op) {
+    for (int i = 0; i < (int) Op::COUNT; ++i)
+        if (name == op_names[i]) {
+            op = (Op) i;
+            return true;
+        }
+    return false;
+}
+
+const char * reg_name(int reg) {
+    assert(reg < VREG_BASE);
+    return reg_names[reg];
+}
+
+int parse_reg(const std::string & name) {
+    for (int i = 0; i < VREG_BASE; ++i)
+        if (name == reg_names[i])
+            return i;
+    return -1;
+}
+
+bool defines_first(Op op) {
+    return op != Op::SW && ! is_control(op);
+}
+
+bool is_control(Op op) {
+    return op == Op::J || op == Op::BEQZ || op == Op::BNEZ || op == Op::CALL || op == Op::RET;
+}
+
+bool reads_reg(const MInst & inst, int reg) {
+    for (int i = defines_first(inst.op) ? 1 : 0; i < 3; ++i)
+        if (inst.ops[i] == mreg(reg))
+            return true;
+    return false;
+}
+
+static std::string operand(const MOperand & opnd) {
+    switch (opnd.kind) {
+    case MOperand::Reg:
+        return reg_name(opnd.value);
+    case MOperand::Imm:
+        return std::to_string(opnd.value);
+    case MOperand::Sym:
+        return symbol_name(opnd.value);
+    case MOperand::Hi:
+        return "%hi(" + symbol_name(opnd.value) + ")";
+    case MOperand::Lo:
+        return "%lo(" + symbol_name(opnd.value) + ")";
+    default:
+        return "";
+    }
+}
+
+void print_function(const MachineFunction & mf, std::string & res) {
+    for (size_t b = 0; b < mf.blocks.size(); ++b) {
+        res += symbol_name(mf.blocks[b].label) + ":\n";
+        for (uint32_t i = mf.blocks[b].begin; i < mf.block_end(b); ++i) {
+            const auto & inst = mf.insts[i];
+            switch (inst.op) {
+            case Op::LW:
+            case Op::SW:
+                res += std::string(op_name(inst.op)) + " " + operand(inst.ops[0]) + ", " + operand(inst.ops[2]) + "(" + operand(inst.ops[1]) + ")\n";
+                break;
+            default:
+                res += op_name(inst.op);
+                for (int k = 0; k < 3 && inst.ops[k].kind != MOperand::None; ++k)
+                    res += (k ? ", " : " ") + operand(inst.ops[k]);
+                res += "\n";
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// RV32 通用寄存器的编号; 不小于 VREG_BASE 的是指令选择产生的虚拟寄存器, 由 assign_vregs 换成物理寄存器
+enum Reg : int32_t {
+    ZERO, RA, SP, GP, TP, T0, T1, T2,
+    S0, S1, A0, A1, A2, A3, A4, A5,
+    A6, A7, S2, S3, S4, S5, S6, S7,
+    S8, S9, S10, S11, T3, T4, T5, T6,
+    VREG_BASE
+};
+
+enum class Op : uint8_t {
+    LI, LA, LUI, MV, SEQZ, SNEZ,
+    ADD, SUB, MUL, DIV, REM, SLT, SGT, SLTU, XOR, OR, AND, SLL, SRL, SRA, CZERO_EQZ,
+    SH1ADD, SH2ADD, SH3ADD, MIN, MAX,
+    ADDI, SLTI, XORI, ORI, ANDI,
+    LW, SW,
+    RDCYCLE, RDINSTRET,
+    J, BEQZ, BNEZ, CALL, RET,
+    COUNT
+};
+
+struct MOperand {
+    // Hi / Lo 是符号地址的 %hi(sym) / %lo(sym)
+    enum Kind : uint8_t { None, Reg, Imm, Sym, Hi, Lo };
+
+    Kind    kind  = None;
+    int32_t value = 0; // 寄存器编号 / 立即数 / 符号编号
+
+    bool operator==(const MOperand & o) const { return kind == o.kind && value == o.value; }
+    bool operator!=(const MOperand & o) const { return ! (*this == o); }
+};
+
+inline MOperand mreg(int r) { return {MOperand::Reg, r}; }
+inline MOperand mimm(int v) { return {MOperand::Imm, v}; }
+inline MOperand msym(int s) { return {MOperand::Sym, s}; }
+inline MOperand mhi(int s) { return {MOperand::Hi, s}; }
+inline MOperand mlo(int s) { return {MOperand::Lo, s}; }
+
+// 操作数的排列:
+//   R 型 rd, rs1, rs2    I 型 rd, rs1, imm    li rd, imm    la rd, sym    mv/seqz/snez rd, rs
+//   lui rd, hi           lw rd, base, imm     sw rs, base, imm     rdcycle/rdinstret rd
+//   j sym                beqz/bnez rs, sym    call sym             ret
+// I 型和访存的 imm 也可以是 lo
+struct MInst {
+    Op       op;
+    MOperand ops[3];
+};
+
+struct MBlock {
+    int      label;
+    uint32_t begin;
+};
+
+// 一个函数的机器指令. 基本块是 insts 上连续的区间, 每个标号开始一个新的基本块;
+// 0 号块的标号是函数名, 存放序言
+struct MachineFunction {
+    std::vector<MInst>  insts;
+    std::vector<MBlock> blocks;
+    int                 vregs = 0; // 已分配的虚拟寄存器个数
+
+    void label(int sym) { blocks.push_back({sym, (uint32_t) insts.size()}); }
+    int  new_vreg() { return VREG_BASE + vregs++; }
+    void emit(Op op, MOperand a = {}, MOperand b = {}, MOperand c = {}) { insts.push_back({op, {a, b, c}}); }
+
+    uint32_t block_end(size_t b) const { return b + 1 < blocks.size() ? blocks[b + 1].begin : insts.size(); }
+};
+
+// 标号和全局符号的名字表
+int                 intern(const std::string & name);
+const std::string & symbol_name(int sym);
+
+const char * op_name(Op op);
+bool         parse_op(const std::string & name, Op & op);
+const char * reg_name(int reg);
+int          parse_reg(const std::string & name);
+
+// 第一个操作数是否是被写入的寄存器
+bool defines_first(Op op);
+// 是否转移控制: 跳转, 分支, 调用和返回
+bool is_control(Op op);
+bool reads_reg(const MInst & inst, int reg);
+
+void print_function(const MachineFunction & mf, std::string & res);
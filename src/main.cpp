@@ -6,7 +6,9 @@
 #include <string>
 
 #include "ast.h"
+#include "koopa_interp.h"
 #include "koopa_riscv.h"
+#include "options.h"
 
 using namespace std;
 
@@ -21,10 +23,15 @@ extern int    yyparse(unique_ptr<BaseAST> & ast);
 int main(int argc, const char * argv[]) {
     // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
     // compiler 模式 输入文件 -o 输出文件
-    assert(argc == 5);
+    // 之后可以附加若干优化/目标选项, 如 -march=rv32im_zicond
+    assert(argc >= 5);
     auto mode   = argv[1];
     auto input  = argv[2];
     auto output = argv[4];
+    for (int i = 5; i < argc; ++i)
+        if (! parse_option(argv[i]))
+            std::cerr << "unknown option: " << argv[i] << std::endl;
+    options.runtime_routines = mode == string("-riscv") || mode == string("-perf") || mode == string("-run");
     // std::string  mode   = "-koopa";
     // const char * input  = "hello.c";
     // const char * output = "hello.koopa";
@@ -38,11 +45,13 @@ int main(int argc, const char * argv[]) {
     auto                ret = yyparse(ast);
     assert(! ret);
 
-    // 输出解析得到的 AST, 其实就是个字符串
-    std::cout << "AST:" << std::endl
-              << std::endl;
-    ast->Dump();
-    cout << endl;
+    // 输出解析得到的 AST, 其实就是个字符串. -run 模式下 stdout 属于被执行的程序
+    if (mode != string("-run")) {
+        std::cout << "AST:" << std::endl
+                  << std::endl;
+        ast->Dump();
+        cout << endl;
+    }
 
     unique_ptr<CompUnitAST> comp(dynamic_cast<CompUnitAST *>(ast.release()));
     koopa_raw_program_t     krp = comp->to_koopa_raw_program();
@@ -82,5 +91,11 @@ int main(int argc, const char * argv[]) {
         yyout.close();
     }
 
+    // 直接解释执行 IR, 输出文件中是每个函数和基本块的执行统计
+    if (mode == string("-run")) {
+        std::ofstream report(output);
+        return run_koopa_program(krp, report);
+    }
+
     return 0;
 }
\ No newline at end of file
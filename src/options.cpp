@@ -0,0 +1,115 @@
+#include "options.h"
+
+CompileOptions options;
+
+static bool has_prefix(const std::string & str, const std::string & prefix) {
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool parse_march(const std::string & march) {
+    if (! has_prefix(march, "rv32"))
+        return false;
+
+    size_t pos = 4;
+    for (; pos < march.size() && march[pos] != '_' && march[pos] != 'z' && march[pos] != 'x'; ++pos)
+        if (march[pos] == 'c')
+            options.rvc = true;
+        else if (march[pos] == 'v')
+            options.rvv = true;
+
+    while (pos < march.size()) {
+        if (march[pos] == '_')
+            ++pos;
+        size_t      end = march.find('_', pos);
+        std::string ext = march.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        if (ext == "zicond")
+            options.zicond = true;
+        else if (ext == "zba")
+            options.zba = true;
+        else if (ext == "zbb")
+            options.zbb = true;
+        else if (ext == "zca")
+            options.rvc = true;
+        else if (ext == "zve32x" || ext == "zve32f" || ext == "zve64x")
+            options.rvv = true;
+        pos = end == std::string::npos ? march.size() : end;
+    }
+    return true;
+}
+
+bool parse_mtune(const std::string & mtune) {
+    if (mtune == "generic")
+        options.tune = Tune::Generic;
+    else if (mtune == "rocket")
+        options.tune = Tune::Rocket;
+    else if (mtune == "sifive-7-series")
+        options.tune = Tune::Sifive7;
+    else
+        return false;
+    return true;
+}
+
+bool parse_option(const std::string & arg) {
+    if (has_prefix(arg, "-march="))
+        return parse_march(arg.substr(7));
+    if (has_prefix(arg, "-mtune="))
+        return parse_mtune(arg.substr(7));
+    if (arg == "-fif-conversion")
+        options.if_conversion = true;
+    else if (arg == "-fno-if-conversion")
+        options.if_conversion = false;
+    else if (arg == "-floop-idiom")
+        options.loop_idiom = true;
+    else if (arg == "-fno-loop-idiom")
+        options.loop_idiom = false;
+    else if (arg == "-fpromote-globals")
+        options.promote_globals = true;
+    else if (arg == "-fno-promote-globals")
+        options.promote_globals = false;
+    else if (arg == "-fsroa")
+        options.sroa = true;
+    else if (arg == "-fno-sroa")
+        options.sroa = false;
+    else if (arg == "-fpeephole")
+        options.peephole = true;
+    else if (arg == "-fno-peephole")
+        options.peephole = false;
+    else if (arg == "-fpeephole-stats")
+        options.peephole_stats = true;
+    else if (arg == "-fipa-ra")
+        options.ipa_ra = true;
+    else if (arg == "-fno-ipa-ra")
+        options.ipa_ra = false;
+    else if (arg == "-fregalloc=fast")
+        options.fast_regalloc = true;
+    else if (arg == "-fregalloc=global")
+        options.fast_regalloc = false;
+    else if (arg == "-fschedule-insns")
+        options.schedule = true;
+    else if (arg == "-fno-schedule-insns")
+        options.schedule = false;
+    else if (arg == "-fcode-size-report")
+        options.code_size_report = true;
+    else if (arg == "-finstrument-cycles")
+        options.instrument_cycles = true;
+    else if (arg == "-fprofile-generate")
+        options.profile_generate = true;
+    else if (has_prefix(arg, "-fprofile-generate=")) {
+        options.profile_generate      = true;
+        options.profile_generate_path = arg.substr(19);
+    } else if (arg == "-fprofile-use")
+        options.profile_use = options.profile_generate_path;
+    else if (has_prefix(arg, "-fprofile-use="))
+        options.profile_use = arg.substr(14);
+    else if (has_prefix(arg, "-msmall-data-limit="))
+        options.small_data_limit = std::stoi(arg.substr(19));
+    else if (has_prefix(arg, "-ftree-parallelize-loops="))
+        options.parallel_threads = std::stoi(arg.substr(25));
+    else if (has_prefix(arg, "-fparallel-threshold="))
+        options.parallel_threshold = std::stoi(arg.substr(21));
+    else if (has_prefix(arg, "-funswitch-budget="))
+        options.unswitch_budget = std::stoi(arg.substr(18));
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+
+// 调度时使用哪种流水线的延迟模型, 由 -mtune= 决定
+enum class Tune { Generic, Rocket, Sifive7 };
+
+// 编译选项, 由 main 解析命令行中 "-o 输出文件" 之后的参数填入
+struct CompileOptions {
+    // 循环判断外提 (unswitching) 后所有副本的 AST 结点总数上限
+    int unswitch_budget = 1024;
+
+    // 是否把小的无副作用分支/短路表达式转换为无分支的计算
+    bool if_conversion = true;
+    // 允许被推测执行的表达式的最大代价 (运算次数)
+    int if_conversion_cost = 8;
+
+    // 是否把逐个元素复制/填充的循环改写为 __sysy_memcpy / __sysy_memset 调用
+    bool loop_idiom = true;
+
+    // 能否调用 runtime.h 中的例程: 只有本编译器的后端 (-riscv/-perf) 会把它们附在程序后面,
+    // -run 的解释器直接实现它们; -koopa 输出的 IR 只能链接标准的 SysY 运行时库. 由 main 按模式设置
+    bool runtime_routines = false;
+
+    // 是否在循环中把全局标量暂存到局部变量里
+    bool promote_globals = true;
+
+    // 是否把只用常量下标访问的小局部数组拆成标量, 以及拆分的元素个数上限
+    bool sroa          = true;
+    int  sroa_max_size = 16;
+
+    // 不超过此大小 (字节) 的全局变量放进 .sdata/.sbss, 由链接器松弛为以 gp 为基址的访问; 0 表示不使用
+    int small_data_limit = 8;
+
+    // 是否对生成的汇编做窥孔优化, 以及是否在 stderr 输出每条规则的应用次数
+    bool peephole       = true;
+    bool peephole_stats = false;
+
+    // 是否做过程间寄存器分配: 按调用图自底向上算出各函数实际改写的寄存器,
+    // 让非叶函数的值也能住在寄存器里, 跨过调用时只用被调用者不改写的寄存器
+    bool ipa_ra = true;
+
+    // 快速编译时使用的寄存器分配 (-fregalloc=fast): 只在基本块内把值留在寄存器里, 不做上面的全局分配
+    bool fast_regalloc = false;
+
+    // 是否在基本块内做指令调度
+    bool schedule = true;
+    Tune tune     = Tune::Generic;
+
+    // 把 DOALL 循环分给多少个线程执行, 不大于 1 时不做并行化; 迭代次数少于阈值时仍然串行执行
+    int parallel_threads   = 1;
+    int parallel_threshold = 1024;
+
+    // -fprofile-generate[=文件]: 给每个基本块插入计数器, main 返回时把次数写入文件;
+    // -fprofile-use[=文件]: 读入这样的文件, 用于基本块排布和寄存器分配的权重
+    bool        profile_generate      = false;
+    std::string profile_generate_path = "sysy.prof";
+    std::string profile_use;
+
+    // 是否在每个函数的入口和返回处读 cycle/instret 计数器, main 返回时在 stderr 输出各函数的统计
+    bool instrument_cycles = false;
+
+    // 是否在 stderr 输出生成代码压缩前后的大小估计
+    bool code_size_report = false;
+
+    // 目标特性, 由 -march= 决定; rvc 时偏向生成能被压缩成 16 位的指令, rvv 时向量化简单的数组循环
+    bool zicond = false;
+    bool zba    = false;
+    bool zbb    = false;
+    bool rvc    = false;
+    bool rvv    = false;
+};
+
+extern CompileOptions options;
+
+bool parse_march(const std::string & march);
+bool parse_mtune(const std::string & mtune);
+
+bool parse_option(const std::string & arg);
@@ -0,0 +1,282 @@
+#include "peephole.h"
+#include <cassert>
+
+// 代码生成在每条 Koopa 指令内部使用的临时寄存器, 在标号和跳转处都已死亡
+static bool is_scratch(int reg) {
+    return reg == T0 || reg == T1 || reg == T2 || reg == T6;
+}
+
+static bool is_imm12(const MOperand & opnd) {
+    return opnd.kind == MOperand::Imm && opnd.value >= -2048 && opnd.value <= 2047;
+}
+
+// 规则里的操作数: 常量, 变量 $a-$z (第一次出现时绑定, 之后要求相同), 或者 $* (其余全部操作数)
+struct PatOperand {
+    enum Kind : uint8_t { Const, Var, Rest };
+
+    Kind     kind;
+    int      var;
+    MOperand value;
+};
+
+// 助记符为 $op 时匹配任意指令
+struct PatInst {
+    bool       any_op;
+    Op         op;
+    PatOperand ops[3];
+    int        n;
+};
+
+struct Match {
+    MOperand var[26];
+    bool     bound[26] = {};
+    Op       op;
+    MOperand rest[3];
+    int      nrest = 0;
+
+    // 窗口之后, 本基本块中尚未处理的指令是 mf->insts[next, end)
+    const MachineFunction * mf;
+    uint32_t                next, end;
+    int                     next_label; // 下一个基本块的标号, 没有时为 -1
+
+    MOperand & operator[](char v) { return var[v - 'a']; }
+
+    // 变量 v 绑定的寄存器在窗口之后不再被读取
+    bool dead(char v) const {
+        const auto & opnd = var[v - 'a'];
+        if (opnd.kind != MOperand::Reg)
+            return false;
+        for (uint32_t i = next; i < end; ++i) {
+            const auto & inst = mf->insts[i];
+            if (reads_reg(inst, opnd.value))
+                return false;
+            if (defines_first(inst.op) && inst.ops[0] == opnd)
+                return true;
+            if (is_control(inst.op))
+                return is_scratch(opnd.value);
+        }
+        return is_scratch(opnd.value);
+    }
+};
+
+struct PeepholeRule {
+    const char *              name;
+    std::vector<const char *> pattern;
+    std::vector<const char *> replacement;
+    bool (*cond)(Match & m); // 可为空, 也可以补充绑定供替换使用
+};
+
+static bool temp_dead(Match & m) {
+    return m.dead('t');
+}
+
+static bool result_copy(Match & m) {
+    return defines_first(m.op) && m.dead('t');
+}
+
+static bool imm_operand(Match & m) {
+    return m['s'] != m['t'] && is_imm12(m['i']) && m.dead('t');
+}
+
+static bool neg_imm_operand(Match & m) {
+    m['n'] = mimm(-m['i'].value);
+    return imm_operand(m) && is_imm12(m['n']);
+}
+
+static bool distinct(Match & m) {
+    return m['s'] != m['d'];
+}
+
+static bool falls_through(Match & m) {
+    return m.next == m.end && m['l'] == msym(m.next_label);
+}
+
+static const std::vector<PeepholeRule> rules = {
+    // 值写回栈槽后紧接着又被读出
+    {"store-load", {"sw $a, $o($b)", "lw $a, $o($b)"}, {"sw $a, $o($b)"}, nullptr},
+    {"store-load-copy", {"sw $a, $o($b)", "lw $c, $o($b)"}, {"sw $a, $o($b)", "mv $c, $a"}, nullptr},
+
+    {"self-copy", {"mv $a, $a"}, {}, nullptr},
+    {"jump-to-next", {"j $l"}, {}, falls_through},
+
+    // 结果先算进临时寄存器再复制到目的地
+    {"copy-chain", {"mv $t, $s", "mv $d, $t"}, {"mv $d, $s"}, temp_dead},
+    {"result-copy", {"$op $t, $*", "mv $d, $t"}, {"$op $d, $*"}, result_copy},
+
+    // 常量先 li 进寄存器再参与运算
+    {"add-imm", {"li $t, $i", "add $d, $s, $t"}, {"addi $d, $s, $i"}, imm_operand},
+    {"add-imm-swap", {"li $t, $i", "add $d, $t, $s"}, {"addi $d, $s, $i"}, imm_operand},
+    {"sub-imm", {"li $t, $i", "sub $d, $s, $t"}, {"addi $d, $s, $n"}, neg_imm_operand},
+    {"and-imm", {"li $t, $i", "and $d, $s, $t"}, {"andi $d, $s, $i"}, imm_operand},
+    {"and-imm-swap", {"li $t, $i", "and $d, $t, $s"}, {"andi $d, $s, $i"}, imm_operand},
+    {"or-imm", {"li $t, $i", "or $d, $s, $t"}, {"ori $d, $s, $i"}, imm_operand},
+    {"or-imm-swap", {"li $t, $i", "or $d, $t, $s"}, {"ori $d, $s, $i"}, imm_operand},
+    {"xor-imm", {"li $t, $i", "xor $d, $s, $t"}, {"xori $d, $s, $i"}, imm_operand},
+    {"xor-imm-swap", {"li $t, $i", "xor $d, $t, $s"}, {"xori $d, $s, $i"}, imm_operand},
+    {"slt-imm", {"li $t, $i", "slt $d, $s, $t"}, {"slti $d, $s, $i"}, imm_operand},
+    {"addi-zero", {"addi $d, $s, 0"}, {"mv $d, $s"}, nullptr},
+    {"xori-zero", {"xori $d, $s, 0"}, {"mv $d, $s"}, nullptr},
+
+    // 可交换运算把目的寄存器放在第一个源操作数, 符合 c.add/c.and 等压缩指令的形式
+    {"add-commute", {"add $d, $s, $d"}, {"add $d, $d, $s"}, distinct},
+    {"and-commute", {"and $d, $s, $d"}, {"and $d, $d, $s"}, distinct},
+    {"or-commute", {"or $d, $s, $d"}, {"or $d, $d, $s"}, distinct},
+    {"xor-commute", {"xor $d, $s, $d"}, {"xor $d, $d, $s"}, distinct},
+};
+
+static std::vector<int> fired(rules.size());
+
+static PatOperand parse_operand(const std::string & token) {
+    if (token == "$*")
+        return {PatOperand::Rest, 0, {}};
+    if (token[0] == '$')
+        return {PatOperand::Var, token[1] - 'a', {}};
+    int reg = parse_reg(token);
+    if (reg != -1)
+        return {PatOperand::Const, 0, mreg(reg)};
+    return {PatOperand::Const, 0, mimm(std::stoi(token))};
+}
+
+// 规则的书写与汇编相同, 访存的 "$o($b)" 拆成基址和偏移两个操作数
+static PatInst parse_pattern(const std::string & text) {
+    PatInst pat{false, Op::LI, {}, 0};
+    size_t  space = text.find(' ');
+    auto    name  = text.substr(0, space);
+    if (name == "$op")
+        pat.any_op = true;
+    else {
+        bool ok = parse_op(name, pat.op);
+        assert(ok);
+    }
+
+    for (size_t pos = space; pos != std::string::npos && pos < text.size();) {
+        size_t comma = text.find(',', pos + 1);
+        auto   token = text.substr(pos + 1, comma == std::string::npos ? std::string::npos : comma - pos - 1);
+        while (token[0] == ' ')
+            token.erase(0, 1);
+
+        size_t paren = token.find('(');
+        if (paren != std::string::npos) {
+            pat.ops[pat.n++] = parse_operand(token.substr(paren + 1, token.size() - paren - 2));
+            pat.ops[pat.n++] = parse_operand(token.substr(0, paren));
+        } else
+            pat.ops[pat.n++] = parse_operand(token);
+        pos = comma;
+    }
+    return pat;
+}
+
+static bool match_inst(Match & m, const PatInst & pat, const MInst & inst) {
+    if (pat.any_op)
+        m.op = inst.op;
+    else if (pat.op != inst.op)
+        return false;
+
+    for (int i = 0; i < 3; ++i) {
+        const auto & opnd = inst.ops[i];
+        if (i < pat.n && pat.ops[i].kind == PatOperand::Rest) {
+            for (int j = i; j < 3 && inst.ops[j].kind != MOperand::None; ++j)
+                m.rest[m.nrest++] = inst.ops[j];
+            return m.nrest > 0;
+        }
+        if (i >= pat.n) {
+            if (opnd.kind != MOperand::None)
+                return false;
+        } else if (opnd.kind == MOperand::None)
+            return false;
+        else if (pat.ops[i].kind == PatOperand::Const) {
+            if (opnd != pat.ops[i].value)
+                return false;
+        } else if (m.bound[pat.ops[i].var]) {
+            if (opnd != m.var[pat.ops[i].var])
+                return false;
+        } else {
+            m.var[pat.ops[i].var]   = opnd;
+            m.bound[pat.ops[i].var] = true;
+        }
+    }
+    return true;
+}
+
+static MInst instantiate(const PatInst & pat, const Match & m) {
+    MInst inst{pat.any_op ? m.op : pat.op, {}};
+    int   k = 0;
+    for (int i = 0; i < pat.n; ++i)
+        if (pat.ops[i].kind == PatOperand::Rest)
+            for (int j = 0; j < m.nrest; ++j)
+                inst.ops[k++] = m.rest[j];
+        else
+            inst.ops[k++] = pat.ops[i].kind == PatOperand::Var ? m.var[pat.ops[i].var] : pat.ops[i].value;
+    return inst;
+}
+
+struct CompiledRule {
+    std::vector<PatInst> pattern, replacement;
+};
+
+static const std::vector<CompiledRule> & compiled_rules() {
+    static std::vector<CompiledRule> compiled;
+    if (compiled.empty())
+        for (const auto & rule : rules) {
+            compiled.emplace_back();
+            for (auto text : rule.pattern)
+                compiled.back().pattern.push_back(parse_pattern(text));
+            for (auto text : rule.replacement)
+                compiled.back().replacement.push_back(parse_pattern(text));
+        }
+    return compiled;
+}
+
+// 以 out 末尾为结尾的窗口尝试每一条规则
+static bool rewrite_tail(std::vector<MInst> & out, size_t block_begin, const Match & base) {
+    const auto & compiled = compiled_rules();
+    for (size_t r = 0; r < rules.size(); ++r) {
+        size_t k = compiled[r].pattern.size();
+        if (out.size() - block_begin < k)
+            continue;
+
+        Match m  = base;
+        bool  ok = true;
+        for (size_t i = 0; i < k && ok; ++i)
+            ok = match_inst(m, compiled[r].pattern[i], out[out.size() - k + i]);
+        if (! ok || (rules[r].cond && ! rules[r].cond(m)))
+            continue;
+
+        out.resize(out.size() - k);
+        for (const auto & pat : compiled[r].replacement)
+            out.push_back(instantiate(pat, m));
+        ++fired[r];
+        return true;
+    }
+    return false;
+}
+
+void peephole(MachineFunction & mf) {
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        std::vector<MInst> out;
+        out.reserve(mf.insts.size());
+        for (size_t b = 0; b < mf.blocks.size(); ++b) {
+            uint32_t begin = mf.blocks[b].begin, end = mf.block_end(b);
+            mf.blocks[b].begin = out.size();
+
+            Match base;
+            base.mf         = &mf;
+            base.end        = end;
+            base.next_label = b + 1 < mf.blocks.size() ? mf.blocks[b + 1].label : -1;
+            for (uint32_t i = begin; i < end; ++i) {
+                out.push_back(mf.insts[i]);
+                base.next = i + 1;
+                while (rewrite_tail(out, mf.blocks[b].begin, base))
+                    changed = true;
+            }
+        }
+        mf.insts.swap(out);
+    }
+}
+
+void dump_peephole_stats(std::ostream & os) {
+    for (size_t r = 0; r < rules.size(); ++r)
+        os << "peephole: " << rules[r].name << " " << fired[r] << "\n";
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "machine.h"
+#include <ostream>
+
+// 在每个基本块内按 peephole.cpp 中的规则表反复改写, 直到没有规则能匹配
+void peephole(MachineFunction & mf);
+
+// 每条规则被应用的次数
+void dump_peephole_stats(std::ostream & os);
@@ -0,0 +1,46 @@
+#include "profile.h"
+#include <fstream>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+static std::unordered_map<koopa_raw_basic_block_t, int64_t> counts;
+static std::set<koopa_raw_function_t>                       profiled;
+
+std::string profile_key(koopa_raw_function_t func, koopa_raw_basic_block_t bb) {
+    return std::string(func->name).substr(1) + " " + std::string(bb->name).substr(1);
+}
+
+bool load_profile(const std::string & path, const koopa_raw_program_t & raw) {
+    std::ifstream in(path);
+    if (! in)
+        return false;
+
+    std::map<std::string, int64_t> by_name;
+    std::string                    func, bb;
+    int64_t                        count;
+    while (in >> func >> bb >> count)
+        by_name[func + " " + bb] += count;
+
+    for (size_t i = 0; i < raw.funcs.len; ++i) {
+        auto func = (koopa_raw_function_t) raw.funcs.buffer[i];
+        for (size_t j = 0; j < func->bbs.len; ++j) {
+            auto bb = (koopa_raw_basic_block_t) func->bbs.buffer[j];
+            auto it = by_name.find(profile_key(func, bb));
+            if (it == by_name.end())
+                continue;
+            counts[bb] = it->second;
+            profiled.insert(func);
+        }
+    }
+    return true;
+}
+
+bool has_profile(koopa_raw_function_t func) {
+    return profiled.count(func);
+}
+
+int64_t block_count(koopa_raw_basic_block_t bb) {
+    auto it = counts.find(bb);
+    return it == counts.end() ? 0 : it->second;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "koopa.h"
+#include <cstdint>
+#include <string>
+
+// 基本块在剖析数据中的名字: "函数名 基本块名", 都去掉了 @ 和 % 前缀.
+// 插桩程序退出时每个块输出一行 "函数名 基本块名 执行次数"
+std::string profile_key(koopa_raw_function_t func, koopa_raw_basic_block_t bb);
+
+// 读入 -fprofile-use 指定的文件, 按名字把次数对应到 raw 中的基本块上; 读不到文件时返回 false.
+// 同一个块出现多次时次数相加, 因此多次运行的输出可以直接拼接
+bool load_profile(const std::string & path, const koopa_raw_program_t & raw);
+
+// 函数是否有剖析数据, 以及基本块执行的次数 (没有记录的块为 0)
+bool    has_profile(koopa_raw_function_t func);
+int64_t block_count(koopa_raw_basic_block_t bb);
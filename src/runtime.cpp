@@ -0,0 +1,459 @@
+#include "runtime.h"
+#include "options.h"
+#include <map>
+
+static const char * memset_asm = R"(__sysy_memset:
+li t6, 4
+blt a2, t6, __sysy_memset_tail
+__sysy_memset_loop:
+sw a1, 0(a0)
+sw a1, 4(a0)
+sw a1, 8(a0)
+sw a1, 12(a0)
+addi a0, a0, 16
+addi a2, a2, -4
+bge a2, t6, __sysy_memset_loop
+__sysy_memset_tail:
+beqz a2, __sysy_memset_ret
+sw a1, 0(a0)
+addi a0, a0, 4
+addi a2, a2, -1
+j __sysy_memset_tail
+__sysy_memset_ret:
+ret
+)";
+
+// 整块复制会先读后写四个字; dst 落在 (src, src + 4n) 内时结果与逐个复制不同,
+// 这时退回逐个复制
+static const char * memcpy_asm = R"(__sysy_memcpy:
+bgeu a1, a0, __sysy_memcpy_fast
+slli t0, a2, 2
+add t0, a1, t0
+bltu a0, t0, __sysy_memcpy_tail
+__sysy_memcpy_fast:
+li t6, 4
+blt a2, t6, __sysy_memcpy_tail
+__sysy_memcpy_loop:
+lw t0, 0(a1)
+lw t1, 4(a1)
+lw t2, 8(a1)
+lw t3, 12(a1)
+sw t0, 0(a0)
+sw t1, 4(a0)
+sw t2, 8(a0)
+sw t3, 12(a0)
+addi a0, a0, 16
+addi a1, a1, 16
+addi a2, a2, -4
+bge a2, t6, __sysy_memcpy_loop
+__sysy_memcpy_tail:
+beqz a2, __sysy_memcpy_ret
+lw t0, 0(a1)
+sw t0, 0(a0)
+addi a0, a0, 4
+addi a1, a1, 4
+addi a2, a2, -1
+j __sysy_memcpy_tail
+__sysy_memcpy_ret:
+ret
+)";
+
+// 以下为启用 V 扩展时的版本, 以 e32/m8 分段 (strip-mining) 处理, 每段的长度由 vsetvli 决定
+static const char * rvv_memset_asm = R"(__sysy_memset:
+beqz a2, __sysy_memset_ret
+vsetvli t0, zero, e32, m8, ta, ma
+vmv.v.x v8, a1
+__sysy_memset_loop:
+vsetvli t0, a2, e32, m8, ta, ma
+vse32.v v8, (a0)
+sub a2, a2, t0
+slli t0, t0, 2
+add a0, a0, t0
+bnez a2, __sysy_memset_loop
+__sysy_memset_ret:
+ret
+)";
+
+static const char * rvv_memcpy_asm = R"(__sysy_memcpy:
+beqz a2, __sysy_memcpy_ret
+bgeu a1, a0, __sysy_memcpy_loop
+slli t0, a2, 2
+add t0, a1, t0
+bltu a0, t0, __sysy_memcpy_tail
+__sysy_memcpy_loop:
+vsetvli t0, a2, e32, m8, ta, ma
+vle32.v v8, (a1)
+vse32.v v8, (a0)
+sub a2, a2, t0
+slli t0, t0, 2
+add a0, a0, t0
+add a1, a1, t0
+bnez a2, __sysy_memcpy_loop
+ret
+__sysy_memcpy_tail:
+lw t0, 0(a1)
+sw t0, 0(a0)
+addi a0, a0, 4
+addi a1, a1, 4
+addi a2, a2, -1
+bnez a2, __sysy_memcpy_tail
+__sysy_memcpy_ret:
+ret
+)";
+
+static const char * vsum_asm = R"(__sysy_vsum:
+vsetvli t0, zero, e32, m8, ta, ma
+vmv.v.i v16, 0
+beqz a1, __sysy_vsum_reduce
+__sysy_vsum_loop:
+vsetvli t0, a1, e32, m8, tu, ma
+vle32.v v8, (a0)
+vadd.vv v16, v16, v8
+sub a1, a1, t0
+slli t0, t0, 2
+add a0, a0, t0
+bnez a1, __sysy_vsum_loop
+__sysy_vsum_reduce:
+vsetvli t0, zero, e32, m8, ta, ma
+vmv.s.x v8, zero
+vredsum.vs v8, v16, v8
+vmv.x.s a0, v8
+ret
+)";
+
+// 逐元素运算: dst 落在某个源数组的 (src, src + 4n) 内时, 向量化的结果与逐个计算不同, 退回逐个计算.
+// vv 版本的第二个源是数组 a2, vx 版本是标量 a2
+static std::string elementwise_asm(const std::string & name, const std::string & vop, const std::string & op, bool vv) {
+    std::string res = name + ":\nbeqz a3, " + name + "_ret\nslli t2, a3, 2\n";
+    res += "bgeu a1, a0, " + name + "_check\nadd t1, a1, t2\nbltu a0, t1, " + name + "_tail\n" + name + "_check:\n";
+    if (vv)
+        res += "bgeu a2, a0, " + name + "_loop\nadd t1, a2, t2\nbltu a0, t1, " + name + "_tail\n";
+
+    res += name + "_loop:\nvsetvli t0, a3, e32, m8, ta, ma\nvle32.v v8, (a1)\n";
+    res += vv ? "vle32.v v16, (a2)\n" + vop + " v8, v8, v16\n" : vop + " v8, v8, a2\n";
+    res += "vse32.v v8, (a0)\nsub a3, a3, t0\nslli t0, t0, 2\nadd a0, a0, t0\nadd a1, a1, t0\n";
+    if (vv)
+        res += "add a2, a2, t0\n";
+    res += "bnez a3, " + name + "_loop\nret\n";
+
+    res += name + "_tail:\nlw t0, 0(a1)\n";
+    if (vv)
+        res += "lw t1, 0(a2)\n" + op + " t0, t0, t1\naddi a2, a2, 4\n";
+    else
+        res += op == "sub" ? "sub t0, a2, t0\n" : op + " t0, t0, a2\n";
+    res += "sw t0, 0(a0)\naddi a0, a0, 4\naddi a1, a1, 4\naddi a3, a3, -1\nbnez a3, " + name + "_tail\n";
+    res += name + "_ret:\nret\n";
+    return res;
+}
+
+// __sysy_parallel_for 在 t3 中收到 worker 的地址. 把 [lo, hi) 平均分成 parallel_threads 段,
+// 第一段由自己执行, 其余每段 clone 一个线程 (共享地址空间, 使用 .bss 中固定的栈) 执行.
+// 线程退出时内核把 __sysy_parallel_tids 中对应的字清零并 futex 唤醒, 借此等待所有线程结束,
+// 不需要 A 扩展的原子指令. clone 失败时由自己执行那一段
+static const int parallel_stack_size = 16384;
+static const int clone_flags         = 0x250f00; // VM | FS | FILES | SIGHAND | THREAD | SYSVSEM | CHILD_CLEARTID
+
+static std::string parallel_for_asm() {
+    std::string threads = std::to_string(options.parallel_threads);
+    std::string res     = "__sysy_parallel_for:\n";
+    res += "sub t0, a1, a0\nli t1, " + std::to_string(options.parallel_threshold) + "\nblt t0, t1, __sysy_parallel_serial\n";
+    res += "addi sp, sp, -32\nsw ra, 28(sp)\nsw s0, 24(sp)\nsw s1, 20(sp)\nsw s2, 16(sp)\nsw s3, 12(sp)\nsw s4, 8(sp)\n";
+    res += "la t1, __sysy_parallel_args\nsw a2, 0(t1)\nsw a3, 4(t1)\nsw a4, 8(t1)\nsw a5, 12(t1)\nsw a6, 16(t1)\nsw a7, 20(t1)\nsw t3, 24(t1)\n";
+    // s2 = 每段的长度, s0 = 下一段的开头, s1 = hi, s3 = 下一个线程的编号, s4 = lo
+    res += "li t1, " + threads + "\naddi t0, t0, " + std::to_string(options.parallel_threads - 1) + "\ndiv s2, t0, t1\n";
+    res += "mv s4, a0\nmv s1, a1\nadd s0, a0, s2\nli s3, 1\n";
+    res += R"(__sysy_parallel_spawn:
+bge s0, s1, __sysy_parallel_run
+la t0, __sysy_parallel_stacks
+li t1, )" + std::to_string(parallel_stack_size) + R"(
+mul t1, t1, s3
+add a1, t0, t1
+addi a1, a1, -16
+sw s0, 0(a1)
+add t0, s0, s2
+blt t0, s1, __sysy_parallel_clamped
+mv t0, s1
+__sysy_parallel_clamped:
+sw t0, 4(a1)
+la a4, __sysy_parallel_tids
+slli t0, s3, 2
+add a4, a4, t0
+li t0, 1
+sw t0, 0(a4)
+li a0, )" + std::to_string(clone_flags) + R"(
+li a2, 0
+li a3, 0
+li a7, 220
+ecall
+beqz a0, __sysy_parallel_child
+bgez a0, __sysy_parallel_next_chunk
+sw zero, 0(a4)
+lw a0, 0(a1)
+lw a1, 4(a1)
+call __sysy_parallel_call
+__sysy_parallel_next_chunk:
+add s0, s0, s2
+addi s3, s3, 1
+j __sysy_parallel_spawn
+__sysy_parallel_run:
+mv a0, s4
+add a1, s4, s2
+blt a1, s1, __sysy_parallel_own
+mv a1, s1
+__sysy_parallel_own:
+call __sysy_parallel_call
+li s0, 1
+__sysy_parallel_join:
+bge s0, s3, __sysy_parallel_done
+la t2, __sysy_parallel_tids
+slli t0, s0, 2
+add t2, t2, t0
+__sysy_parallel_wait:
+lw a2, 0(t2)
+beqz a2, __sysy_parallel_joined
+mv a0, t2
+li a1, 0
+li a3, 0
+li a7, 422
+ecall
+j __sysy_parallel_wait
+__sysy_parallel_joined:
+addi s0, s0, 1
+j __sysy_parallel_join
+__sysy_parallel_done:
+fence rw, rw
+lw ra, 28(sp)
+lw s0, 24(sp)
+lw s1, 20(sp)
+lw s2, 16(sp)
+lw s3, 12(sp)
+lw s4, 8(sp)
+addi sp, sp, 32
+ret
+__sysy_parallel_serial:
+jr t3
+__sysy_parallel_call:
+la t0, __sysy_parallel_args
+lw a2, 0(t0)
+lw a3, 4(t0)
+lw a4, 8(t0)
+lw a5, 12(t0)
+lw a6, 16(t0)
+lw a7, 20(t0)
+lw t0, 24(t0)
+jr t0
+__sysy_parallel_child:
+lw a0, 0(sp)
+lw a1, 4(sp)
+call __sysy_parallel_call
+fence rw, rw
+li a0, 0
+li a7, 93
+ecall
+.section .bss
+.align 4
+__sysy_parallel_args:
+.zero 28
+__sysy_parallel_tids:
+.zero )" + std::to_string(4 * options.parallel_threads) + R"(
+.align 4
+__sysy_parallel_stacks:
+.zero )" + std::to_string(parallel_stack_size * (options.parallel_threads - 1)) + R"(
+.text
+)";
+    return res;
+}
+
+// 把 __sysy_prof_counts 中的计数按 __sysy_prof_names 中的名字 (以空格结尾, 空串结束) 逐行写入
+// __sysy_prof_path 指定的文件. 只在 main 返回时调用一次, 除 ra 外不改变任何寄存器
+static const char * prof_dump_asm = R"(__sysy_prof_dump:
+addi sp, sp, -64
+sw a0, 0(sp)
+sw a1, 4(sp)
+sw a2, 8(sp)
+sw a3, 12(sp)
+sw a7, 16(sp)
+sw t0, 20(sp)
+sw t1, 24(sp)
+sw t2, 28(sp)
+sw t3, 32(sp)
+sw t4, 36(sp)
+li a0, -100
+la a1, __sysy_prof_path
+li a2, 0x241
+li a3, 420
+li a7, 56
+ecall
+bltz a0, __sysy_prof_dump_ret
+mv t3, a0
+la t4, __sysy_prof_names
+la t2, __sysy_prof_counts
+__sysy_prof_dump_line:
+lbu t0, 0(t4)
+beqz t0, __sysy_prof_dump_close
+mv t1, t4
+__sysy_prof_dump_strlen:
+addi t1, t1, 1
+lbu t0, 0(t1)
+bnez t0, __sysy_prof_dump_strlen
+mv a0, t3
+mv a1, t4
+sub a2, t1, t4
+li a7, 64
+ecall
+addi t4, t1, 1
+lw t0, 0(t2)
+addi t2, t2, 4
+addi a1, sp, 63
+li t1, 10
+sb t1, 0(a1)
+__sysy_prof_dump_digit:
+addi a1, a1, -1
+remu a2, t0, t1
+addi a2, a2, 48
+sb a2, 0(a1)
+divu t0, t0, t1
+bnez t0, __sysy_prof_dump_digit
+mv a0, t3
+addi a2, sp, 64
+sub a2, a2, a1
+li a7, 64
+ecall
+j __sysy_prof_dump_line
+__sysy_prof_dump_close:
+mv a0, t3
+li a7, 57
+ecall
+__sysy_prof_dump_ret:
+lw a0, 0(sp)
+lw a1, 4(sp)
+lw a2, 8(sp)
+lw a3, 12(sp)
+lw a7, 16(sp)
+lw t0, 20(sp)
+lw t1, 24(sp)
+lw t2, 28(sp)
+lw t3, 32(sp)
+lw t4, 36(sp)
+addi sp, sp, 64
+ret
+)";
+
+// 把 __sysy_cyc_table 中每个函数的 9 个字按 __sysy_cyc_names 中的名字 (空串结束) 逐行写到 stderr:
+// "名字 0x调用次数 0x含子调用周期数 0x自身周期数 0x含子调用指令数 0x自身指令数", 64 位的量高位字在前.
+// 0xab 标出以 " 0x" 开始的字, 其余的字接在前一个字之后. 只在 main 返回时调用一次, 除 ra 外不改变任何寄存器
+static const char * cyc_dump_asm = R"(__sysy_cyc_dump:
+addi sp, sp, -64
+sw a0, 0(sp)
+sw a1, 4(sp)
+sw a2, 8(sp)
+sw a7, 12(sp)
+sw t0, 16(sp)
+sw t1, 20(sp)
+sw t2, 24(sp)
+sw t3, 28(sp)
+sw t4, 32(sp)
+sw t5, 36(sp)
+la t4, __sysy_cyc_names
+la t2, __sysy_cyc_table
+__sysy_cyc_dump_line:
+lbu t0, 0(t4)
+beqz t0, __sysy_cyc_dump_ret
+mv t1, t4
+__sysy_cyc_dump_strlen:
+addi t1, t1, 1
+lbu t0, 0(t1)
+bnez t0, __sysy_cyc_dump_strlen
+li a0, 2
+mv a1, t4
+sub a2, t1, t4
+li a7, 64
+ecall
+addi t4, t1, 1
+li t3, 0
+__sysy_cyc_dump_word:
+lw t0, 0(t2)
+addi t2, t2, 4
+addi a1, sp, 40
+mv a2, a1
+li t1, 0xab
+srl t1, t1, t3
+andi t1, t1, 1
+beqz t1, __sysy_cyc_dump_hex
+li t1, 32
+sb t1, 0(a2)
+li t1, 48
+sb t1, 1(a2)
+li t1, 120
+sb t1, 2(a2)
+addi a2, a2, 3
+__sysy_cyc_dump_hex:
+li t5, 8
+__sysy_cyc_dump_digit:
+srli t1, t0, 28
+slli t0, t0, 4
+addi t1, t1, 48
+li a0, 58
+blt t1, a0, __sysy_cyc_dump_store
+addi t1, t1, 39
+__sysy_cyc_dump_store:
+sb t1, 0(a2)
+addi a2, a2, 1
+addi t5, t5, -1
+bnez t5, __sysy_cyc_dump_digit
+addi t3, t3, 1
+li t1, 9
+bne t3, t1, __sysy_cyc_dump_write
+li t1, 10
+sb t1, 0(a2)
+addi a2, a2, 1
+__sysy_cyc_dump_write:
+sub a2, a2, a1
+li a0, 2
+li a7, 64
+ecall
+li t1, 9
+bne t3, t1, __sysy_cyc_dump_word
+j __sysy_cyc_dump_line
+__sysy_cyc_dump_ret:
+lw a0, 0(sp)
+lw a1, 4(sp)
+lw a2, 8(sp)
+lw a7, 12(sp)
+lw t0, 16(sp)
+lw t1, 20(sp)
+lw t2, 24(sp)
+lw t3, 28(sp)
+lw t4, 32(sp)
+lw t5, 36(sp)
+addi sp, sp, 64
+ret
+)";
+
+const char * runtime_asm(const std::string & name) {
+    if (name == "__sysy_memset")
+        return options.rvv ? rvv_memset_asm : memset_asm;
+    if (name == "__sysy_memcpy")
+        return options.rvv ? rvv_memcpy_asm : memcpy_asm;
+    if (name == "__sysy_vsum")
+        return vsum_asm;
+    if (name == "__sysy_prof_dump")
+        return prof_dump_asm;
+    if (name == "__sysy_cyc_dump")
+        return cyc_dump_asm;
+    if (name == "__sysy_parallel_for") {
+        static const std::string asm_text = parallel_for_asm();
+        return asm_text.c_str();
+    }
+
+    static const std::map<std::string, std::string> elementwise = {
+        {"__sysy_vadd_vv", elementwise_asm("__sysy_vadd_vv", "vadd.vv", "add", true)},
+        {"__sysy_vsub_vv", elementwise_asm("__sysy_vsub_vv", "vsub.vv", "sub", true)},
+        {"__sysy_vmul_vv", elementwise_asm("__sysy_vmul_vv", "vmul.vv", "mul", true)},
+        {"__sysy_vadd_vx", elementwise_asm("__sysy_vadd_vx", "vadd.vx", "add", false)},
+        {"__sysy_vrsub_vx", elementwise_asm("__sysy_vrsub_vx", "vrsub.vx", "sub", false)},
+        {"__sysy_vmul_vx", elementwise_asm("__sysy_vmul_vx", "vmul.vx", "mul", false)},
+    };
+    auto it = elementwise.find(name);
+    return it == elementwise.end() ? nullptr : it->second.c_str();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+// 编译器自己生成调用的运行时例程, 汇编随程序一起输出
+// 参数与返回值遵循标准调用约定, 只使用 a0-a3, t0-t6 与向量寄存器 v8-v23.
+// 例外是 __sysy_parallel_for: 它使用 a0-a7, 保存并恢复 s0-s4, 并且会调用 worker;
+// 以及只在 main 返回前调用的两个 dump 例程, 它们用 a7 发起系统调用
+
+// __sysy_memset(int * dst, int value, int n): dst[0 .. n) = value
+// __sysy_memcpy(int * dst, int * src, int n): 与逐个元素正向复制等价, 允许重叠
+// 启用 V 扩展时 (同样与逐个元素正向计算等价):
+// __sysy_v{add,sub,mul}_vv(int * dst, int * a, int * b, int n): dst[i] = a[i] op b[i]
+// __sysy_v{add,rsub,mul}_vx(int * dst, int * a, int x, int n):  dst[i] = a[i] + x, x - a[i], a[i] * x
+// __sysy_vsum(int * a, int n): 返回 a[0 .. n) 之和
+// 并行化时: __sysy_parallel_for(int lo, int hi, a2-a7), worker 地址在 t3 中;
+// 效果与 worker(lo, hi, a2-a7) 相同, 迭代次数足够多时分给多个线程执行
+// -fprofile-generate 时: __sysy_prof_dump() 在 main 返回前把各基本块的执行次数写入剖析文件
+// -finstrument-cycles 时: __sysy_cyc_dump() 在 main 返回前把各函数的调用次数, 周期数和指令数写到 stderr
+const char * runtime_asm(const std::string & name);
@@ -0,0 +1,104 @@
+#include "rvc.h"
+
+void use_compressible_scratch(MachineFunction & mf) {
+    for (auto & inst : mf.insts)
+        for (auto & opnd : inst.ops)
+            if (opnd.kind == MOperand::Reg && (opnd.value == T0 || opnd.value == T1))
+                opnd.value = opnd.value == T0 ? S0 : S1;
+}
+
+// c.lw/c.sw/c.beqz 以及 c.sub 等只能编码 x8-x15
+static bool is_creg(const MOperand & opnd) {
+    return opnd.kind == MOperand::Reg && opnd.value >= S0 && opnd.value <= A5;
+}
+
+static bool is_nonzero_reg(const MOperand & opnd) {
+    return opnd.kind == MOperand::Reg && opnd.value != ZERO;
+}
+
+static bool in_range(const MOperand & opnd, int lo, int hi, int align = 1) {
+    return opnd.kind == MOperand::Imm && opnd.value >= lo && opnd.value <= hi && opnd.value % align == 0;
+}
+
+static bool fits_imm12(int v) {
+    return v >= -2048 && v <= 2047;
+}
+
+int encoded_size(const MInst & inst) {
+    switch (inst.op) {
+    case Op::LI:
+        // 超出 12 位时展开成 lui + addi, 低 12 位为 0 时只要 lui
+        return fits_imm12(inst.ops[1].value) || ! (inst.ops[1].value & 0xfff) ? 4 : 8;
+    case Op::LA:
+    case Op::CALL:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+bool compressible(const MInst & inst) {
+    const auto & a = inst.ops[0];
+    const auto & b = inst.ops[1];
+    const auto & c = inst.ops[2];
+    switch (inst.op) {
+    case Op::LI:
+        return is_nonzero_reg(a) && in_range(b, -32, 31);
+    case Op::MV:
+        return is_nonzero_reg(a) && is_nonzero_reg(b);
+    case Op::ADD:
+        return is_nonzero_reg(a) && a == b && is_nonzero_reg(c);
+    case Op::SUB:
+    case Op::XOR:
+    case Op::OR:
+    case Op::AND:
+        return is_creg(a) && a == b && is_creg(c);
+    case Op::ADDI:
+        if (a == mreg(SP) && b == mreg(SP))
+            return in_range(c, -512, 496, 16) && c.value;
+        if (is_creg(a) && b == mreg(SP))
+            return in_range(c, 4, 1020, 4);
+        return is_nonzero_reg(a) && a == b && in_range(c, -32, 31) && c.value;
+    case Op::ANDI:
+        return is_creg(a) && a == b && in_range(c, -32, 31);
+    case Op::LW:
+        if (b == mreg(SP))
+            return is_nonzero_reg(a) && in_range(c, 0, 252, 4);
+        return is_creg(a) && is_creg(b) && in_range(c, 0, 124, 4);
+    case Op::SW:
+        if (b == mreg(SP))
+            return in_range(c, 0, 252, 4);
+        return is_creg(a) && is_creg(b) && in_range(c, 0, 124, 4);
+    case Op::J:
+    case Op::RET:
+        return true;
+    case Op::BEQZ:
+    case Op::BNEZ:
+        return is_creg(a);
+    default:
+        return false;
+    }
+}
+
+static int total_insts, compressed_insts, total_bytes, compressed_bytes;
+
+void count_code_size(const MachineFunction & mf) {
+    for (const auto & inst : mf.insts) {
+        int size = encoded_size(inst);
+        ++total_insts;
+        total_bytes += size;
+        if (compressible(inst)) {
+            ++compressed_insts;
+            compressed_bytes += size - 2;
+        } else
+            compressed_bytes += size;
+    }
+}
+
+void dump_code_size(std::ostream & os) {
+    os << "code size: " << total_bytes << " bytes, " << compressed_bytes << " bytes with RVC ("
+       << compressed_insts << " of " << total_insts << " instructions compressible";
+    if (total_bytes)
+        os << ", -" << (total_bytes - compressed_bytes) * 100 / total_bytes << "%";
+    os << ")\n";
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "machine.h"
+#include <ostream>
+
+// 启用 C 扩展时, 把代码生成的主要临时寄存器 t0/t1 换成 s0/s1 (x8/x9),
+// 使 c.sub/c.and/c.beqz/c.lw/c.sw 等只接受 x8-x15 的压缩形式可用; 调用者负责保存 s0/s1
+void use_compressible_scratch(MachineFunction & mf);
+
+// 指令 (含伪指令展开) 的字节数, 以及能否被汇编器压缩成 16 位的形式
+int  encoded_size(const MInst & inst);
+bool compressible(const MInst & inst);
+
+// 累计各函数的代码大小, 在 stderr 输出压缩前后的估计
+void count_code_size(const MachineFunction & mf);
+void dump_code_size(std::ostream & os);
@@ -0,0 +1,167 @@
+#include "schedule.h"
+#include "options.h"
+#include <algorithm>
+
+// 单发射顺序流水线的模型: 各类指令的结果延迟, 以及乘/除法部件两次发射之间至少间隔的周期数
+struct PipelineModel {
+    int alu, load, mul, div;
+    int mul_interval, div_interval;
+};
+
+// 按 Tune 的顺序排列
+static const PipelineModel models[] = {
+    {1, 3, 3, 20, 1, 20}, // generic
+    {1, 3, 4, 33, 4, 33}, // rocket: 迭代式乘除法器, 不能流水
+    {1, 3, 3, 34, 1, 34}, // sifive-7-series
+};
+
+enum Unit { ALU, LOAD, STORE, MUL, DIV };
+
+static Unit unit_of(Op op) {
+    switch (op) {
+    case Op::LW:
+        return LOAD;
+    case Op::SW:
+        return STORE;
+    case Op::MUL:
+        return MUL;
+    case Op::DIV:
+    case Op::REM:
+        return DIV;
+    default:
+        return ALU;
+    }
+}
+
+static int latency(const PipelineModel & model, Op op) {
+    switch (unit_of(op)) {
+    case LOAD:
+        return model.load;
+    case MUL:
+        return model.mul;
+    case DIV:
+        return model.div;
+    default:
+        return model.alu;
+    }
+}
+
+static int def_of(const MInst & inst) {
+    return defines_first(inst.op) && inst.ops[0].kind == MOperand::Reg && inst.ops[0].value != ZERO ? inst.ops[0].value : -1;
+}
+
+static bool is_counter_read(Op op) {
+    return op == Op::RDCYCLE || op == Op::RDINSTRET;
+}
+
+// 以 sp 为基址的访问按偏移区分, 以 %lo(sym) 寻址的 .sdata 变量按符号区分, 两者互不重叠;
+// 其余的指针可能指向任何地方
+static bool may_alias(const MInst & a, const MInst & b) {
+    bool a_stack = a.ops[1] == mreg(SP), a_small = a.ops[2].kind == MOperand::Lo;
+    bool b_stack = b.ops[1] == mreg(SP), b_small = b.ops[2].kind == MOperand::Lo;
+    if ((a_stack || a_small) && (b_stack || b_small))
+        return a_stack == b_stack && a.ops[2] == b.ops[2];
+    return true;
+}
+
+// b 在原顺序中位于 a 之后, 返回 b 最早能在 a 发射后多少个周期发射, 没有依赖时返回 0
+static int dependence(const PipelineModel & model, const MInst & a, const MInst & b) {
+    // 计数器的读取不跨越任何指令, 量出的区间才和插桩的位置一致
+    if (is_counter_read(a.op) || is_counter_read(b.op))
+        return 1;
+
+    int a_def = def_of(a), b_def = def_of(b);
+    if (a_def != -1 && reads_reg(b, a_def))
+        return latency(model, a.op);
+    if (b_def != -1 && (reads_reg(a, b_def) || a_def == b_def))
+        return 1;
+
+    Unit ua = unit_of(a.op), ub = unit_of(b.op);
+    if ((ua == STORE && (ub == LOAD || ub == STORE)) || (ua == LOAD && ub == STORE))
+        return may_alias(a, b) ? 1 : 0;
+    return 0;
+}
+
+static void schedule_range(std::vector<MInst> & insts, uint32_t begin, uint32_t end, const PipelineModel & model) {
+    int n = end - begin;
+    if (n < 2)
+        return;
+
+    std::vector<std::vector<std::pair<int, int>>> succ(n);
+    std::vector<int>                              npred(n, 0);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < i; ++j)
+            if (int delay = dependence(model, insts[begin + j], insts[begin + i])) {
+                succ[j].push_back({i, delay});
+                ++npred[i];
+            }
+
+    // 优先级: 到区间末尾的最长延迟路径
+    std::vector<int> height(n);
+    for (int i = n - 1; i >= 0; --i) {
+        height[i] = latency(model, insts[begin + i].op);
+        for (auto [s, delay] : succ[i])
+            height[i] = std::max(height[i], delay + height[s]);
+    }
+
+    std::vector<int> earliest(n, 0), ready, order;
+    for (int i = 0; i < n; ++i)
+        if (! npred[i])
+            ready.push_back(i);
+
+    int  cycle = 0, mul_free = 0, div_free = 0;
+    auto issue_time = [&](int i) {
+        Unit unit = unit_of(insts[begin + i].op);
+        return std::max(earliest[i], unit == MUL ? mul_free : unit == DIV ? div_free : 0);
+    };
+
+    while (! ready.empty()) {
+        int best = -1, soonest = -1;
+        for (int k = 0; k < (int) ready.size(); ++k) {
+            int i = ready[k], t = issue_time(i);
+            if (t <= cycle && (best == -1 || height[i] > height[ready[best]] || (height[i] == height[ready[best]] && i < ready[best])))
+                best = k;
+            if (soonest == -1 || t < issue_time(ready[soonest]) || (t == issue_time(ready[soonest]) && i < ready[soonest]))
+                soonest = k;
+        }
+        if (best == -1) {
+            best  = soonest;
+            cycle = issue_time(ready[best]);
+        }
+
+        int i = ready[best];
+        ready.erase(ready.begin() + best);
+        order.push_back(i);
+
+        Unit unit = unit_of(insts[begin + i].op);
+        if (unit == MUL)
+            mul_free = cycle + model.mul_interval;
+        else if (unit == DIV)
+            div_free = cycle + model.div_interval;
+
+        for (auto [s, delay] : succ[i]) {
+            earliest[s] = std::max(earliest[s], cycle + delay);
+            if (! --npred[s])
+                ready.push_back(s);
+        }
+        ++cycle;
+    }
+
+    std::vector<MInst> scheduled;
+    for (int i : order)
+        scheduled.push_back(insts[begin + i]);
+    std::copy(scheduled.begin(), scheduled.end(), insts.begin() + begin);
+}
+
+void schedule(MachineFunction & mf) {
+    const auto & model = models[(int) options.tune];
+    for (size_t b = 0; b < mf.blocks.size(); ++b) {
+        uint32_t begin = mf.blocks[b].begin, end = mf.block_end(b);
+        for (uint32_t i = begin; i < end; ++i)
+            if (is_control(mf.insts[i].op)) {
+                schedule_range(mf.insts, begin, i, model);
+                begin = i + 1;
+            }
+        schedule_range(mf.insts, begin, end, model);
+    }
+}
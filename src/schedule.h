@@ -0,0 +1,7 @@
+#pragma once
+
+#include "machine.h"
+
+// 在基本块内, 以跳转/调用为界做表调度: 按 -mtune 选择的延迟模型,
+// 优先发射关键路径上的指令, 把 lw 和乘除法的使用者尽量往后挪
+void schedule(MachineFunction & mf);
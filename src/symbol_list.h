@@ -9,7 +9,8 @@ public:
         Var,
         Array,
         Pointer,
-        Function
+        Function,
+        ScalarArray
     } type;
     void * number;
     LValSymbol() = default;
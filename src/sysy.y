@@ -228,7 +228,7 @@ Stmt: OpenStmt | ClosStmt;
 
 OpenStmt: IF '(' Exp ')' Stmt {
     auto ast = new BranchStmtAST();
-    ast->exp = unique_ptr<BaseAST>($3);
+    ast->exp = unique_ptr<ValueBaseAST>($3);
     ast->lval = unique_ptr<BaseAST>($5);
     ast->branch_id = branch_id++;
     
@@ -236,7 +236,7 @@ OpenStmt: IF '(' Exp ')' Stmt {
   }
   | IF '(' Exp ')' ClosStmt ELSE OpenStmt {
     auto ast = new BranchStmtAST();
-    ast->exp = unique_ptr<BaseAST>($3);
+    ast->exp = unique_ptr<ValueBaseAST>($3);
     ast->lval = unique_ptr<BaseAST>($5);
     ast->rval = unique_ptr<BaseAST>($7);
     ast->branch_id = branch_id++;
@@ -245,7 +245,7 @@ OpenStmt: IF '(' Exp ')' Stmt {
   }
   | WHILE '(' Exp ')' OpenStmt {
     auto ast = new WhileStmtAST();
-    ast -> exp = unique_ptr<BaseAST>($3);
+    ast -> exp = unique_ptr<ValueBaseAST>($3);
     ast -> stmt = unique_ptr<BaseAST>($5);
     ast -> while_id = branch_id++;
 
@@ -256,7 +256,7 @@ OpenStmt: IF '(' Exp ')' Stmt {
 ClosStmt : SimpStmt
   | IF '(' Exp ')' ClosStmt ELSE ClosStmt {
     auto ast = new BranchStmtAST();
-    ast->exp = unique_ptr<BaseAST>($3);
+    ast->exp = unique_ptr<ValueBaseAST>($3);
     ast->lval = unique_ptr<BaseAST>($5);
     ast->rval = unique_ptr<BaseAST>($7);
     ast->branch_id = branch_id++;
@@ -265,7 +265,7 @@ ClosStmt : SimpStmt
   }
   | WHILE '(' Exp ')' ClosStmt {
     auto ast = new WhileStmtAST();
-    ast -> exp = unique_ptr<BaseAST>($3);
+    ast -> exp = unique_ptr<ValueBaseAST>($3);
     ast -> stmt = unique_ptr<BaseAST>($5);
     ast -> while_id = branch_id++;
 
@@ -0,0 +1,81 @@
+#include "vreg.h"
+#include <algorithm>
+#include <cassert>
+
+// 虚拟寄存器只在一条 Koopa 指令的代码内部存活, 不跨基本块, 也不跨调用,
+// 所以只需在每个基本块内按活跃区间分配这几个临时寄存器
+static const int pool[] = {T0, T1, T2};
+
+// 区间 [begin, end]: 在 begin 处写入, 最后在 end 处读取;
+// 一条指令读完一个区间的值后可以在同一个寄存器里开始另一个区间
+struct Interval {
+    int begin, end;
+};
+
+static bool overlaps(const Interval & a, const Interval & b) {
+    return a.begin < b.end && b.begin < a.end;
+}
+
+void assign_vregs(MachineFunction & mf) {
+    if (! mf.vregs)
+        return;
+
+    std::vector<Interval> live(mf.vregs, {-1, -1});
+    std::vector<int>      phys(mf.vregs, -1);
+
+    for (size_t b = 0; b < mf.blocks.size(); ++b) {
+        int begin = mf.blocks[b].begin, end = mf.block_end(b);
+
+        // 直接写出的 t0-t2 (以及调用对它们的破坏) 先占住各自的区间
+        std::vector<Interval> used[3];
+        std::vector<int>      vregs;
+        for (int i = begin; i < end; ++i) {
+            const MInst & inst = mf.insts[i];
+            for (int p = 0; p < 3; ++p) {
+                int r = pool[p];
+                if (inst.op == Op::CALL || (defines_first(inst.op) && inst.ops[0] == mreg(r) && ! reads_reg(inst, r)))
+                    used[p].push_back({i, i});
+                else if (reads_reg(inst, r)) {
+                    if (used[p].empty())
+                        used[p].push_back({begin, i});
+                    used[p].back().end = i;
+                }
+            }
+            for (const MOperand & opnd : inst.ops) {
+                if (opnd.kind != MOperand::Reg || opnd.value < VREG_BASE)
+                    continue;
+                Interval & iv = live[opnd.value - VREG_BASE];
+                if (iv.begin == -1) {
+                    iv.begin = i;
+                    vregs.push_back(opnd.value - VREG_BASE);
+                }
+                assert(iv.begin >= begin);
+                iv.end = i;
+            }
+        }
+
+        // 按开始位置依次分配, 在空闲的寄存器中选最早空出来的那个, 给后面的调度留出余地
+        for (int v : vregs) {
+            int best = -1, best_free = 0;
+            for (int p = 0; p < 3; ++p) {
+                bool ok   = true;
+                int  free = -1;
+                for (const Interval & iv : used[p]) {
+                    ok = ok && ! overlaps(iv, live[v]);
+                    if (iv.begin <= live[v].begin)
+                        free = std::max(free, iv.end);
+                }
+                if (ok && (best == -1 || free < best_free))
+                    best = p, best_free = free;
+            }
+            assert(best != -1);
+            used[best].push_back(live[v]);
+            phys[v] = pool[best];
+        }
+    }
+
+    for (MInst & inst : mf.insts)
+        for (MOperand & opnd : inst.ops)
+            if (opnd.kind == MOperand::Reg && opnd.value >= VREG_BASE)
+                opnd.value = phys[opnd.value - VREG_BASE];
+}
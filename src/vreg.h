@@ -0,0 +1,6 @@
+#pragma once
+
+#include "machine.h"
+
+// 把指令选择产生的虚拟寄存器换成 t0-t2
+void assign_vregs(MachineFunction & mf);
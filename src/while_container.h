@@ -1,11 +1,20 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "koopa_util.h"
 
+// 循环中暂存到局部变量里的全局变量
+struct PromotedGlobal {
+    std::string       name;
+    koopa_raw_value_t global;
+    koopa_raw_value_t local;
+    bool              written;
+};
+
 struct KoopaWhile {
     koopa_raw_basic_block_data_t * while_entry;
     koopa_raw_basic_block_data_t * while_body;
@@ -15,6 +24,11 @@ struct KoopaWhile {
 class LoopMaintainer {
     std::vector<KoopaWhile> loop_stk;
 
+    // 已外提的循环不变条件, 以及当前生成的副本中该条件的取值
+    std::map<const void *, bool> unswitch_map;
+
+    std::vector<PromotedGlobal> promoted;
+
 public:
     void add(koopa_raw_basic_block_data_t * while_entry, koopa_raw_basic_block_data_t * while_body, koopa_raw_basic_block_data_t * end_block) {
         KoopaWhile kw;
@@ -25,4 +39,21 @@ public:
     }
     KoopaWhile get() { return *loop_stk.rbegin(); }
     void       pop() { loop_stk.pop_back(); }
+
+    void set_unswitch(const void * branch, bool taken) { unswitch_map[branch] = taken; }
+    void clear_unswitch(const void * branch) { unswitch_map.erase(branch); }
+    int  unswitch_depth() const { return unswitch_map.size(); }
+
+    bool get_unswitch(const void * branch, bool & taken) const {
+        auto it = unswitch_map.find(branch);
+        if (it == unswitch_map.end())
+            return false;
+        taken = it->second;
+        return true;
+    }
+
+    void push_promoted(const PromotedGlobal & g) { promoted.push_back(g); }
+    void pop_promoted() { promoted.pop_back(); }
+
+    const std::vector<PromotedGlobal> & get_promoted() const { return promoted; }
 };
\ No newline at end of file